@@ -0,0 +1,108 @@
+/**
+ * @file FillBench.cxx
+ * @author Jon Burr
+ * @brief Compare the owning, allocation-free and columnar ways of filling a Histogram
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Usage: FillBench [nEvents]
+ *
+ * The same events are filled into a (pt, sample) histogram with fill(value_t), which builds a
+ * vector of owned values for each event, with fill(makeValues(...)), which only views them, and
+ * with fillColumns. The resulting histograms are checked to agree and the time per event of each
+ * is printed.
+ */
+
+#include "H5Histograms/CategoryAxis.h"
+#include "H5Histograms/FixedBinAxis.h"
+#include "H5Histograms/Histogram.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    using histogram_t = H5Histograms::Histogram<double>;
+
+    /// Fill a fresh histogram with one of the methods, returning the time per event in ns
+    template <typename F>
+    double timePerEvent(histogram_t &histogram, std::size_t nEvents, F &&fill)
+    {
+        auto start = std::chrono::steady_clock::now();
+        fill(histogram);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / nEvents;
+    }
+
+    bool sameContents(const histogram_t &lhs, const histogram_t &rhs)
+    {
+        if (lhs.nEntries() != rhs.nEntries())
+            return false;
+        histogram_t::const_iterator lhsItr = lhs.begin();
+        histogram_t::const_iterator rhsItr = rhs.begin();
+        for (; lhsItr != lhs.end(); ++lhsItr, ++rhsItr)
+            if (lhsItr.contents() != rhsItr.contents())
+                return false;
+        return true;
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    using namespace H5Histograms;
+    std::size_t nEvents = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    std::vector<std::string> samples{"ttbar", "wjets", "zjets", "diboson", "singletop"};
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> ptDist(0, 110);
+    std::uniform_int_distribution<std::size_t> sampleDist(0, samples.size() - 1);
+    std::vector<double> pts(nEvents);
+    std::vector<std::string> eventSamples(nEvents);
+    for (std::size_t idx = 0; idx < nEvents; ++idx)
+    {
+        pts[idx] = ptDist(rng);
+        eventSamples[idx] = samples[sampleDist(rng)];
+    }
+
+    auto create = [&samples]()
+    { return histogram_t::create(FixedBinAxis("pt", 100, 0, 100), CategoryAxis("sample", samples)); };
+    histogram_t owned = create();
+    histogram_t viewed = create();
+    histogram_t columns = create();
+    double ownedTime = timePerEvent(
+        owned, nEvents,
+        [&](histogram_t &h)
+        {
+            for (std::size_t idx = 0; idx < nEvents; ++idx)
+                h.fill(HistogramBase::value_t{pts[idx], eventSamples[idx]});
+        });
+    double viewedTime = timePerEvent(
+        viewed, nEvents,
+        [&](histogram_t &h)
+        {
+            for (std::size_t idx = 0; idx < nEvents; ++idx)
+                h.fill(HistogramBase::makeValues(pts[idx], eventSamples[idx]));
+        });
+    double columnsTime = timePerEvent(
+        columns, nEvents,
+        [&](histogram_t &h) { h.fillColumns({pts.data(), eventSamples.data()}, nEvents); });
+    if (!sameContents(owned, viewed) || !sameContents(owned, columns))
+    {
+        std::cerr << "The fill methods do not produce the same histogram" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::setw(20) << "method" << std::setw(12) << "ns/event" << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::fixed;
+    for (const auto &[name, time] : {std::make_pair("fill(value_t)", ownedTime),
+                                     std::make_pair("fill(makeValues)", viewedTime),
+                                     std::make_pair("fillColumns", columnsTime)})
+        std::cout << std::setw(20) << name << std::setw(12) << std::setprecision(1) << time << std::setw(10)
+                  << std::setprecision(2) << ownedTime / time << std::endl;
+    return 0;
+}
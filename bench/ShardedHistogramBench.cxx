@@ -0,0 +1,88 @@
+/**
+ * @file ShardedHistogramBench.cxx
+ * @author Jon Burr
+ * @brief Measure how ShardedHistogram fill throughput scales with the number of threads
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Usage: ShardedHistogramBench [nFillsPerThread] [maxThreads]
+ *
+ * For 1, 2, 4, ... up to maxThreads (by default the hardware concurrency) threads, each thread
+ * fills the same number of random values into one shared ShardedHistogram. The merged histogram
+ * is checked to hold every fill and the total and per thread throughput are printed, along with
+ * the speedup over a single thread.
+ */
+
+#include "H5Histograms/FixedBinAxis.h"
+#include "H5Histograms/ShardedHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    /// Fill from nThreads threads at once, returning the total number of fills per second
+    double fillsPerSecond(const std::vector<double> &values, std::size_t nThreads)
+    {
+        using namespace H5Histograms;
+        ShardedHistogram<double> histogram(Histogram<double>::create(FixedBinAxis("x", 100, 0, 1)));
+        std::atomic<bool> start{false};
+        std::vector<std::thread> threads;
+        for (std::size_t idx = 0; idx < nThreads; ++idx)
+            threads.emplace_back(
+                [&histogram, &values, &start]()
+                {
+                    // Create the shard before timing starts
+                    histogram.local();
+                    while (!start.load(std::memory_order_acquire))
+                        std::this_thread::yield();
+                    for (double value : values)
+                        histogram.fill(HistogramBase::makeValues(value));
+                });
+        auto begin = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        for (std::thread &thread : threads)
+            thread.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+        if (histogram.merged().nEntries() != nThreads * values.size())
+        {
+            std::cerr << "The merged histogram is missing fills from " << nThreads << " threads" << std::endl;
+            std::exit(1);
+        }
+        return nThreads * values.size() / elapsed.count();
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t nFills = argc > 1 ? std::stoul(argv[1]) : 10000000;
+    std::size_t maxThreads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> dist(-0.1, 1.1);
+    std::vector<double> values(nFills);
+    for (double &value : values)
+        value = dist(rng);
+
+    std::cout << std::setw(8) << "threads" << std::setw(16) << "Mfills/s" << std::setw(20) << "Mfills/s/thread"
+              << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    double single = 0;
+    for (std::size_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2)
+    {
+        double rate = fillsPerSecond(values, nThreads) / 1e6;
+        if (nThreads == 1)
+            single = rate;
+        std::cout << std::setw(8) << nThreads << std::setw(16) << rate << std::setw(20) << rate / nThreads
+                  << std::setw(10) << rate / single << std::endl;
+    }
+    return 0;
+}
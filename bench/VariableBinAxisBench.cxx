@@ -0,0 +1,76 @@
+/**
+ * @file VariableBinAxisBench.cxx
+ * @author Jon Burr
+ * @brief Compare VariableBinAxis lookups against a plain std::lower_bound over the edges
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Usage: VariableBinAxisBench [nValues]
+ *
+ * For several numbers of log-spaced edges the same random values are looked up both ways,
+ * checking that the bins agree, and the time per lookup of each is printed.
+ */
+
+#include "H5Histograms/VariableBinAxis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    /// Run a lookup over every value, returning the time per value in ns
+    template <typename F>
+    double timePerValue(const std::vector<double> &values, std::vector<std::size_t> &out, F &&lookup)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t idx = 0; idx < values.size(); ++idx)
+            out[idx] = lookup(values[idx]);
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / values.size();
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    std::size_t nValues = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    std::mt19937_64 rng(12345);
+    std::cout << std::setw(8) << "nEdges" << std::setw(16) << "lower_bound/ns" << std::setw(16) << "axis/ns"
+              << std::setw(10) << "speedup" << std::endl;
+    for (std::size_t nEdges : {8, 20, 200, 2000, 20000})
+    {
+        std::vector<double> edges(nEdges);
+        for (std::size_t idx = 0; idx < nEdges; ++idx)
+            edges[idx] = std::pow(10., 4. * idx / (nEdges - 1));
+        H5Histograms::VariableBinAxis axis("x", edges);
+        // Include values outside of the axis range to exercise the flow bins
+        std::uniform_real_distribution<double> dist(0, 4.1);
+        std::vector<double> values(nValues);
+        for (double &value : values)
+            value = std::pow(10., dist(rng)) - 0.5;
+
+        std::vector<std::size_t> expected(nValues);
+        std::vector<std::size_t> result(nValues);
+        double reference = timePerValue(
+            values, expected,
+            [&edges](double value)
+            { return std::size_t(std::lower_bound(edges.begin(), edges.end(), value) - edges.begin()); });
+        double lookup = timePerValue(values, result, [&axis](double value) { return axis.findBinIndex(value); });
+        if (result != expected)
+        {
+            std::cerr << "Bins found with " << nEdges << " edges do not match std::lower_bound" << std::endl;
+            return 1;
+        }
+        std::cout << std::setw(8) << nEdges << std::setw(16) << std::fixed << std::setprecision(1) << reference
+                  << std::setw(16) << lookup << std::setw(10) << std::setprecision(2) << reference / lookup
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file AdaptiveHistogram.h
+ * @author Jon Burr
+ * @brief ND histogram whose bin storage widens as the contents grow
+ * @version 0.0.0
+ * @date 2022-01-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_ADAPTIVEHISTOGRAM_H
+#define H5HISTOGRAMS_ADAPTIVEHISTOGRAM_H
+
+#include "H5Histograms/HistogramBase.h"
+#include "H5Composites/CompositeDefinition.h"
+
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief ND histogram whose bin storage widens as the contents grow
+     *
+     * All bins start as 1 byte unsigned integers. When a bin would overflow the whole array is
+     * widened to 2, 4 or 8 bytes, and a negative or non-integer weight switches it to double.
+     * Like Histogram the sum of squared weights is only stored once a weight other than 1 is
+     * used.
+     *
+     * It is written out in the same format as Histogram using the narrowest type that holds every
+     * bin, so it reads back as (and merges with) a Histogram of that type.
+     */
+    class AdaptiveHistogram : public HistogramBase
+    {
+        friend class H5Composites::CompositeDefinition<AdaptiveHistogram>;
+        /// Definition of everything except the bin contents, which are written by hand
+        static const H5Composites::CompositeDefinition<AdaptiveHistogram> &compositeDefinition();
+
+    public:
+        /// Bin contents, ordered from narrowest to widest
+        using array_t = std::variant<
+            std::vector<std::uint8_t>,
+            std::vector<std::uint16_t>,
+            std::vector<std::uint32_t>,
+            std::vector<std::uint64_t>,
+            std::vector<double>>;
+
+        AdaptiveHistogram(const void *buffer, const H5::DataType &dtype);
+        AdaptiveHistogram(std::vector<std::unique_ptr<IAxis>> &&axes);
+
+        template <typename... AXES>
+        static AdaptiveHistogram create(const AXES &... axes)
+        {
+            std::vector<std::unique_ptr<IAxis>> ptrs;
+            ptrs.reserve(sizeof...(axes));
+            (ptrs.push_back(std::make_unique<AXES>(axes)), ...);
+            return std::move(ptrs);
+        }
+
+        H5::DataType h5DType() const override;
+        void writeBuffer(void *buffer) const override;
+        std::string dtypeKey() const override;
+        void writeBufferWithDType(void *buffer, const H5::DataType &dtype) const override;
+
+        void fill(const value_t &values, double weight = 1);
+
+        /// Fill the histogram from one non-owning value per axis, see Histogram::fill
+        void fill(const IAxis::value_view_t *values, std::size_t nValues, double weight = 1);
+
+        template <std::size_t N>
+        void fill(const std::array<IAxis::value_view_t, N> &values, double weight = 1)
+        {
+            fill(values.data(), N, weight);
+        }
+
+        /// Fill the histogram from columns of values, see Histogram::fillColumns
+        void fillColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t nEvents,
+            const double *weights = nullptr);
+
+        /// Contents above 2^53 lose precision when returned as a double
+        double contents(const index_t &indices) const;
+
+        double sumW2(const index_t &indices) const;
+
+        std::size_t nEntries() const { return m_nEntries; }
+
+        /// Whether the sum of squared weights is stored separately from the counts
+        bool isWeighted() const { return m_weighted; }
+
+        /// The type currently used to store the bins
+        H5::PredType storageDType() const;
+
+    private:
+        /// Add to a bin
+        void add(std::size_t offset, double weight);
+
+        void resize(const std::vector<IAxis::ExtensionInfo> &axisExtensions);
+
+        /// Start storing the sum of squared weights separately from the counts
+        void makeWeighted();
+
+        /// Read a bin array of any numeric type, storing it in the narrowest type that fits
+        array_t readArray(const void *buffer, const H5::DataType &dtype, const std::string &name) const;
+
+        /// The index in array_t of the type used to write the bins
+        std::size_t writtenIndex() const;
+
+        bool m_weighted;
+        std::size_t m_nEntries;
+        array_t m_counts;
+        /// Only used once the histogram is weighted
+        array_t m_sumW2;
+    }; //> end class AdaptiveHistogram
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_ADAPTIVEHISTOGRAM_H
@@ -98,7 +98,7 @@ namespace H5Histograms
         const std::vector<std::size_t> &axisSizes() const { return m_axisSizes; }
 
         /// The strides for each axis
-        std::vector<std::size_t> strides() const;
+        const std::vector<std::size_t> &strides() const { return m_strides; }
 
         /// The total number of entries in the array
         std::size_t nEntries() const;
@@ -137,6 +137,7 @@ namespace H5Histograms
         const_iterator end() const;
     private:
         std::vector<std::size_t> m_axisSizes;
+        std::vector<std::size_t> m_strides;
     };
 }
 
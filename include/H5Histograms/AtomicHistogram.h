@@ -0,0 +1,132 @@
+/**
+ * @file AtomicHistogram.h
+ * @author Jon Burr
+ * @brief Histogram with atomic bins that many threads can fill at once
+ * @version 0.0.0
+ * @date 2022-01-20
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef H5HISTOGRAMS_ATOMICHISTOGRAM_H
+#define H5HISTOGRAMS_ATOMICHISTOGRAM_H
+
+#include "H5Histograms/Histogram.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Histogram with atomic bins that many threads can fill at once
+     * 
+     * Unlike ShardedHistogram only a single copy of the bins exists, which makes this suitable for
+     * very large histograms. Bins are updated with relaxed atomic additions (compare-and-swap loops
+     * for floating point types) so none of the axes may be extendable, as extending an axis would
+     * move every bin.
+     * 
+     * The contents are read through snapshot. It is written out in the same layout as a weighted
+     * Histogram, straight from the atomic bins, so a stored AtomicHistogram reads back as a
+     * Histogram. Each fill registers itself on a per-thread counter while it runs, so snapshot and
+     * writeBuffer can hold back new fills and wait for those in progress to finish. The copy then
+     * contains only complete fills, with every count matching its sumW2 and the number of entries,
+     * at the cost of briefly pausing the filling threads. contents and sumW2 do not pause filling
+     * so two separate calls may not see the same fills.
+     */
+    template <typename STORAGE>
+    class AtomicHistogram : public HistogramBase
+    {
+    public:
+        AtomicHistogram(std::vector<std::unique_ptr<IAxis>> &&axes);
+
+        /// Create an empty histogram with the same axes as an existing histogram
+        AtomicHistogram(const HistogramBase &prototype);
+
+        template <typename... AXES>
+        static AtomicHistogram create(const AXES &... axes)
+        {
+            std::vector<std::unique_ptr<IAxis>> ptrs;
+            ptrs.reserve(sizeof...(axes));
+            (ptrs.push_back(std::make_unique<AXES>(axes)), ...);
+            return std::move(ptrs);
+        }
+
+        H5::DataType h5DType() const override;
+        void writeBuffer(void *buffer) const override;
+        std::string dtypeKey() const override;
+        void writeBufferWithDType(void *buffer, const H5::DataType &dtype) const override;
+
+        void fill(const value_t &values, STORAGE weight = 1);
+
+        void fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight = 1);
+
+        template <std::size_t N>
+        void fill(const std::array<IAxis::value_view_t, N> &values, STORAGE weight = 1)
+        {
+            fill(values.data(), N, weight);
+        }
+
+        /// Fill the histogram from columns of values, see Histogram::fillColumns
+        void fillColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t nEvents,
+            const STORAGE *weights = nullptr);
+
+        STORAGE contents(const index_t &indices) const;
+
+        STORAGE sumW2(const index_t &indices) const;
+
+        std::size_t nEntries() const;
+
+        /// Copy the current contents into an ordinary histogram
+        Histogram<STORAGE> snapshot() const;
+
+    private:
+        /// Keep the two sums for a bin together so that a fill only touches one cache line
+        struct Bin
+        {
+            std::atomic<STORAGE> count;
+            std::atomic<STORAGE> sumW2;
+        };
+
+        /// Counter on its own cache line, several are used so that threads do not all contend on one
+        struct alignas(64) StripedCounter
+        {
+            std::atomic<std::size_t> value{0};
+        };
+
+        static constexpr std::size_t nEntryCounters = 16;
+
+        void add(std::size_t offset, STORAGE weight);
+
+        void addEntries(std::size_t n);
+
+        /**
+         * @brief Register a fill on the calling thread's counter, waiting for any paused read
+         * @return The counter to pass to endFill
+         */
+        std::size_t beginFill();
+
+        /// Mark the fill registered by beginFill as complete
+        void endFill(std::size_t counter);
+
+        /// Call read while no fills are in progress, holding back any new ones until it returns
+        template <typename F>
+        void whilePaused(F &&read) const;
+
+        std::unique_ptr<Bin[]> m_bins;
+        std::array<StripedCounter, nEntryCounters> m_nEntries;
+        /// The number of fills in progress, on the same stripes as the entries
+        std::array<StripedCounter, nEntryCounters> m_fillsInProgress;
+        /// Set while a read waits for or copies the bins
+        mutable std::atomic<bool> m_paused{false};
+        /// Only one read may pause filling at once
+        mutable std::mutex m_pauseMutex;
+    }; //> end class AtomicHistogram<STORAGE>
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_ATOMICHISTOGRAM_H
@@ -40,6 +40,10 @@ namespace H5Histograms
         
         void merge(const CategoryAxis &other);
 
+        std::unique_ptr<IAxis> clone() const override;
+
+        std::string dtypeKey() const override;
+
         static index_t overflowName() { return "UNCATEGORISED"; }
 
         /// The type of this axis
@@ -60,6 +64,27 @@ namespace H5Histograms
         /// Get the offset of a bin from its value
         std::size_t binOffsetFromValue(const IAxis::value_t &value) const override;
 
+        /// Get the offset of a bin from a category value
+        std::size_t binOffsetFromCategory(std::string_view value) const override;
+
+        /// Get the offsets of the bins for a block of category values
+        void binOffsetsFromCategory(const std::string *values, std::size_t n, std::size_t *offsets) const override;
+
+        /**
+         * @brief Resolve a category to a token that can be filled in place of the string
+         * 
+         * On a non-extendable axis unknown categories resolve to the overflow bin. On an
+         * extendable axis they throw std::out_of_range, use Histogram::token to add the category
+         * to the axis first
+         */
+        CategoryToken token(std::string_view category) const;
+
+        /// Get the offset of a bin from a category token. Throws std::out_of_range for invalid tokens
+        std::size_t binOffsetFromToken(CategoryToken token) const override;
+
+        /// Get the offsets of the bins for a block of category tokens
+        void binOffsetsFromTokens(const CategoryToken *tokens, std::size_t n, std::size_t *offsets) const override;
+
         /// Get the offset of a bin from its index
         std::size_t binOffsetFromIndex(const IAxis::index_t &index) const override;
         
@@ -82,10 +107,32 @@ namespace H5Histograms
 
         ExtensionInfo compareAxis(const IAxis &other) const;
 
+        /// New categories are added at the end so existing bins do not move
+        ExtensionInfo mergeAxis(const IAxis &other) override;
+
+        std::unique_ptr<IAxis> slice(std::size_t first, std::size_t last, std::size_t &offset) const override;
+
     private:
+        /// The offset of a category, SIZE_MAX if it is not on the axis
+        std::size_t findCategory(std::string_view category) const;
+
+        /// Append a new category to the axis
+        void addCategory(const std::string &category);
+
+        /// Insert a category into the hash index
+        void indexCategory(std::size_t offset);
+
+        /// Rebuild the hash index from the categories
+        void buildIndex();
+
         std::string m_label;
         std::vector<std::string> m_categories;
         bool m_extendable;
+        /**
+         * Open addressing hash table holding category offsets, SIZE_MAX marks an empty slot. It is
+         * derived from m_categories and is not written out
+         */
+        std::vector<std::size_t> m_index;
     }; //> end class CategoryAxis
 }
 
@@ -0,0 +1,133 @@
+/**
+ * @file Checkpointer.h
+ * @author Jon Burr
+ * @brief Periodic checkpointing of histograms that are still being filled
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_CHECKPOINTER_H
+#define H5HISTOGRAMS_CHECKPOINTER_H
+
+#include "H5Histograms/Histogram.h"
+#include "H5Cpp.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Write checkpoints of a histogram on a background thread while it is still filled
+     *
+     * Each checkpoint copies the histogram into a second histogram kept for the purpose, see
+     * Histogram::copyInto, and leaves it to a background thread to write, so the filling thread
+     * is only held up for as long as it takes to copy the bins. There is only one copy so at most
+     * one write is ever in flight, a new checkpoint first waits for the last to finish.
+     *
+     * Checkpoints are written with Histogram::writeCheckpoint. If the histogram tracks its
+     * changes, see Histogram::trackChanges, those are handed over to the copy with the bins, so
+     * only the blocks changed since the last checkpoint are appended. Otherwise each checkpoint
+     * is written under a temporary name and only replaces the last once complete, so if a write
+     * is interrupted Histogram::read still finds the old or the new checkpoint whole.
+     *
+     * The background thread is only used if HDF5 was built thread-safe, see
+     * H5is_library_threadsafe, as otherwise it could call HDF5 at the same time as the caller.
+     * Without it each checkpoint is written by the calling thread before checkpoint returns.
+     */
+    template <typename STORAGE>
+    class Checkpointer
+    {
+    public:
+        /**
+         * @brief Called when a write finishes, with the exception thrown if it failed
+         *
+         * It runs on the background thread, if there is one, before the write counts as finished
+         * so nothing else can submit a checkpoint in the meantime. The callback itself can: it
+         * may call checkpoint once, or tryCheckpoint, and wait returns straight away
+         */
+        using callback_t = std::function<void(std::exception_ptr)>;
+
+        /**
+         * @brief Create the checkpointer and start its background thread if HDF5 is thread-safe
+         *
+         * @param location The group to write the checkpoints in
+         * @param name The name of the checkpoint group
+         * @param layout How to chunk and compress the bins
+         */
+        Checkpointer(const H5::Group &location, const std::string &name, const ChunkedLayout &layout = {});
+
+        /// Waits for any write in flight then stops the background thread
+        ~Checkpointer();
+
+        Checkpointer(const Checkpointer &) = delete;
+        Checkpointer &operator=(const Checkpointer &) = delete;
+
+        /**
+         * @brief Checkpoint a histogram
+         *
+         * @param histogram The histogram, which can be changed again as soon as this returns
+         * @param callback Called once the checkpoint is written
+         *
+         * Waits for any write still in flight first. The changes recorded by the histogram are
+         * cleared as they now belong to the checkpoint
+         */
+        void checkpoint(Histogram<STORAGE> &histogram, callback_t callback = {});
+
+        /// Checkpoint a histogram unless a write is still in flight, returning whether it did
+        bool tryCheckpoint(Histogram<STORAGE> &histogram, callback_t callback = {});
+
+        /// Whether a write is in flight, or from a callback whether it submitted the next
+        bool busy() const;
+
+        /// Wait for any write in flight to finish
+        void wait();
+
+        /// Whether checkpoints are written by a background thread
+        bool isAsynchronous() const { return m_thread.joinable(); }
+
+    private:
+        /// Whether this is the background thread, i.e. whether this was called from a callback
+        bool onWriterThread() const { return std::this_thread::get_id() == m_thread.get_id(); }
+
+        /// Copy the histogram and hand it to the background thread, the lock must be held with no write in flight
+        void submit(Histogram<STORAGE> &histogram, callback_t callback);
+
+        /// The loop run by the background thread
+        void run();
+
+        /// Write a checkpoint on the calling thread
+        void writeNow(Histogram<STORAGE> &histogram, const callback_t &callback);
+
+        /// Write a histogram, returning the exception thrown if it failed
+        std::exception_ptr write(Histogram<STORAGE> &histogram);
+
+        H5::Group m_location;
+        std::string m_name;
+        ChunkedLayout m_layout;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        /// Set from submitting a checkpoint until its callback returns
+        bool m_inFlight{false};
+        /// Set from submitting a checkpoint until the background thread starts writing it
+        bool m_submitted{false};
+        bool m_stop{false};
+        /// Only touched by the background thread while a write is in flight
+        std::optional<Histogram<STORAGE>> m_snapshot;
+        /// Set when a write fails, as the changes it held are lost the next has to rewrite everything.
+        /// Only touched by the thread that writes
+        bool m_rewrite{false};
+        callback_t m_callback;
+        std::thread m_thread;
+    }; //> end class Checkpointer<STORAGE>
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_CHECKPOINTER_H
@@ -0,0 +1,84 @@
+/**
+ * @file ChunkedLayout.h
+ * @author Jon Burr
+ * @brief Options for writing histogram bins as chunked, compressed datasets
+ * @version 0.0.0
+ * @date 2022-01-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_CHUNKEDLAYOUT_H
+#define H5HISTOGRAMS_CHUNKEDLAYOUT_H
+
+#include "H5Cpp.h"
+
+#include <string>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief How the bins of a histogram are stored when it is written as separate datasets
+     *
+     * The histogram is written as a group holding a scalar compound "header" dataset with the
+     * axes and the number of entries, followed by "counts" and, for weighted histograms, "sumW2"
+     * datasets shaped like the axes including their flow bins. Only the bin datasets are chunked
+     * and filtered so HDF5 can compress them and read back parts of them.
+     *
+     * Incremental checkpoints (see Histogram::writeCheckpoint) append the bins that changed to
+     * three extendable datasets in the same group: "deltaRuns" lists runs of consecutive bins and
+     * where their contents start in "deltaValues", which holds each count followed by its sumW2
+     * for weighted runs, and "deltaEntries" the number of entries after each checkpoint. The runs
+     * are appended after their values, so values left by a failed write are never read. Reading
+     * the group applies the runs in order on top of the bin datasets.
+     *
+     * When a checkpoint has to replace the group, the new group is written under the name with
+     * partialSuffix added and only moved into place once complete. If that is interrupted after
+     * the old group was dropped, the partial group is the complete checkpoint and is what
+     * Histogram::read reads.
+     */
+    struct ChunkedLayout
+    {
+        /// The name of the dataset holding the axes and number of entries
+        static const std::string headerName;
+        /// The name of the dataset holding the counts
+        static const std::string countsName;
+        /// The name of the dataset holding the sum of squared weights
+        static const std::string sumW2Name;
+        /// The name of the dataset listing the runs of bins in each delta
+        static const std::string deltaRunsName;
+        /// The name of the dataset holding the bin contents of each delta
+        static const std::string deltaValuesName;
+        /// The name of the dataset holding the number of entries after each delta
+        static const std::string deltaEntriesName;
+        /// Added to the name of a checkpoint while a new group is written to replace it
+        static const std::string partialSuffix;
+
+        /// The size that chunks are kept under if their dimensions are not given
+        static constexpr std::size_t defaultChunkBytes = std::size_t(1) << 20;
+
+        /**
+         * @brief The number of bins along each axis in a chunk
+         *
+         * If empty the chunks span whole rows of the innermost axes, splitting the outer axes until
+         * a chunk fits in defaultChunkBytes
+         */
+        std::vector<hsize_t> chunkDims;
+        /// The deflate (gzip) level between 1 and 9, or 0 for no compression
+        unsigned int deflateLevel = 4;
+        /// Whether to shuffle the bytes of each chunk before compressing it
+        bool shuffle = true;
+
+        /**
+         * @brief Create the property list for a bin dataset
+         *
+         * @param dims The shape of the dataset
+         * @param elementSize The size of each bin
+         */
+        H5::DSetCreatPropList createPropList(const std::vector<hsize_t> &dims, std::size_t elementSize) const;
+    }; //> end struct ChunkedLayout
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_CHUNKEDLAYOUT_H
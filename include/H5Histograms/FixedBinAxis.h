@@ -48,6 +48,10 @@ namespace H5Histograms
         
         void merge(const FixedBinAxis &other);
 
+        std::unique_ptr<IAxis> clone() const override;
+
+        std::string dtypeKey() const override;
+
         static std::string registeredName() { return "H5Histograms::FixedBinAxis"; }
 
         /// If the axis is extendable
@@ -65,6 +69,19 @@ namespace H5Histograms
         /// Get the index of a bin from its value
         IAxis::index_t findBin(const IAxis::value_t &value) const override;
 
+        /// Get the index of the bin containing a value. SIZE_MAX if no such bin exists
+        std::size_t findBinIndex(double value) const override;
+
+        /// Get the offset of a bin from a numeric value
+        std::size_t binOffsetFromNumeric(double value) const override;
+
+        /**
+         * @brief Get the offsets of the bins for a block of values
+         * 
+         * Uses AVX-512 or AVX2 when the CPU supports them, chosen at run time
+         */
+        void binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const override;
+
         /**
          * @brief Extend the axis to contain a particular value
          * 
@@ -75,14 +92,24 @@ namespace H5Histograms
 
         ExtensionInfo compareAxis(const IAxis &other) const override;
 
+        ExtensionInfo mergeAxis(const IAxis &other) override;
+
+        /// Throws std::invalid_argument if the range holds none of the non-overflow bins
+        std::unique_ptr<IAxis> slice(std::size_t first, std::size_t last, std::size_t &offset) const override;
+
         /// Get the width of a single bin
         double binWidth() const;
 
     private:
+        /// Recalculate the cached inverse bin width after the axis parameters change
+        void updateInvBinWidth();
+
         std::size_t m_nBins;
         double m_min;
         double m_max;
         ExtensionType m_extension;
+        /// Cached so that finding a bin is a multiplication rather than a division
+        double m_invBinWidth;
     }; //> end class FixedBinAxis
 };     //> end namespace H5Histograms
 
@@ -13,30 +13,96 @@
 #define H5HISTOGRAMS_HISTOGRAM_H
 
 #include "H5Histograms/ArrayIndexer.h"
+#include "H5Histograms/ChunkedLayout.h"
 #include "H5Histograms/HistogramBase.h"
 #include "H5Composites/CompositeDefinition.h"
 
+#include <algorithm>
 #include <type_traits>
+#include <functional>
 #include <iterator>
+#include <memory_resource>
 #include <optional>
 #include <tuple>
 
 namespace H5Histograms
 {
+    template <typename STORAGE>
+    class SparseHistogram;
+
+    template <typename STORAGE>
+    class Checkpointer;
+
     template <typename STORAGE>
     class Histogram : public HistogramBase
     {
         friend class H5Composites::CompositeDefinition<Histogram>;
+        friend class SparseHistogram<STORAGE>;
+        friend class Checkpointer<STORAGE>;
         static const H5Composites::CompositeDefinition<Histogram> &compositeDefinition();
 
     public:
+        /**
+         * @brief Writable reference to the count or sumW2 of a bin
+         *
+         * Reading through the reference changes nothing. Only writing records the bin as changed,
+         * see trackChanges, and writing a sumW2 first stores the sumW2 separately, see isWeighted.
+         * The bin is held by offset so the reference survives the storage being reallocated.
+         */
+        template <bool SUMW2>
+        class BinReference
+        {
+        public:
+            BinReference(Histogram &histogram, std::size_t offset)
+                : m_histo(&histogram), m_offset(offset) {}
+
+            BinReference(const BinReference &other) = default;
+
+            operator STORAGE() const { return SUMW2 ? m_histo->sumW2At(m_offset) : m_histo->countAt(m_offset); }
+
+            BinReference &operator=(STORAGE value)
+            {
+                target() = value;
+                return *this;
+            }
+
+            /// Assign the value of the other bin, not the reference
+            BinReference &operator=(const BinReference &other) { return *this = STORAGE(other); }
+
+            BinReference &operator+=(STORAGE value)
+            {
+                target() += value;
+                return *this;
+            }
+
+            BinReference &operator-=(STORAGE value)
+            {
+                target() -= value;
+                return *this;
+            }
+
+        private:
+            /// Prepare the bin to be written
+            STORAGE &target()
+            {
+                if constexpr (SUMW2)
+                    m_histo->makeWeighted();
+                m_histo->markChanged(m_offset);
+                return SUMW2 ? m_histo->sumW2At(m_offset) : m_histo->countAt(m_offset);
+            }
+
+            Histogram *m_histo;
+            std::size_t m_offset;
+        }; //> end class BinReference<SUMW2>
+
         template <bool CONST>
         class Iterator {
             friend class Iterator<!CONST>;
         public:
-            using store_t = std::conditional_t<CONST, STORAGE, STORAGE &>;
+            using count_t = std::conditional_t<CONST, STORAGE, BinReference<false>>;
+            using sumW2_t = std::conditional_t<CONST, STORAGE, BinReference<true>>;
             using difference_type = std::ptrdiff_t;
-            using value_type = std::tuple<store_t, store_t>;
+            using value_type = std::tuple<count_t, sumW2_t>;
             using pointer = std::conditional_t<CONST, const value_type *, value_type *>;
             using reference = std::conditional_t<CONST, const value_type &, value_type &>;
             using iterator_category = std::forward_iterator_tag;
@@ -67,10 +133,10 @@ namespace H5Histograms
             HistogramBase::index_t indices() const;
 
             /// Get the contents of the bin pointed to
-            store_t contents() { return std::get<0>(**this); }
+            count_t contents() { return std::get<0>(**this); }
 
             /// Get the sumW2 of the bin pointed to
-            store_t sumW2() { return std::get<1>(**this); }
+            sumW2_t sumW2() { return std::get<1>(**this); }
 
             /// Check equality between iterators
             bool operator==(const Iterator &other) const;
@@ -91,6 +157,9 @@ namespace H5Histograms
             Iterator operator--(int);
 
         private:
+            /// The value of the bin at the given offset
+            value_type valueAt(std::size_t offset) const;
+
             ArrayIndexer::const_iterator m_idxItr;
             histogram_t &m_histo;
             std::size_t m_offset;
@@ -100,8 +169,83 @@ namespace H5Histograms
         using const_iterator = Iterator<true>;
         using iterator = Iterator<false>;
 
-        Histogram(const void *buffer, const H5::DataType &dtype);
-        Histogram(std::vector<std::unique_ptr<IAxis>> &&axes);
+        /**
+         * @brief Read a histogram from a buffer
+         * 
+         * @param buffer The buffer
+         * @param dtype The data type of the buffer
+         * @param resource The memory resource used for the bin contents
+         */
+        Histogram(
+            const void *buffer,
+            const H5::DataType &dtype,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Read a histogram from a file
+         * 
+         * @param location The group holding the histogram
+         * @param name The name of the histogram
+         * @param resource The memory resource used for the bin contents
+         * 
+         * Accepts both a dataset holding the histogram as a single element, which may also be a
+         * sparse histogram, and a group written by writeChunked
+         */
+        static Histogram read(
+            const H5::Group &location,
+            const std::string &name,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Read the bins of a histogram in a region
+         * 
+         * @param location The group holding the histogram
+         * @param name The name of the histogram
+         * @param ranges The range of bin offsets to read along each axis, including flow bins
+         * @param resource The memory resource used for the bin contents
+         * 
+         * Returns a histogram whose axes only cover the region, see slice. For a histogram
+         * written by writeChunked only the selected bins are read, through a hyperslab selection.
+         * A histogram written as a single element has to be read whole first.
+         */
+        static Histogram readRegion(
+            const H5::Group &location,
+            const std::string &name,
+            const std::vector<bin_range_t> &ranges,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /// Read the bins of a histogram that cover a box of values, see readRegion and binRanges
+        static Histogram readBox(
+            const H5::Group &location,
+            const std::string &name,
+            const std::vector<std::pair<IAxis::value_t, IAxis::value_t>> &box,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Create an empty histogram
+         * 
+         * @param axes The axes
+         * @param resource The memory resource used for the bin contents, see MemoryResources.h
+         */
+        Histogram(
+            std::vector<std::unique_ptr<IAxis>> &&axes,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+        /**
+         * @brief Create a histogram from existing bin contents
+         * 
+         * @param axes The axes
+         * @param counts The contents of every bin, including the flow bins
+         * @param sumW2 The sum of squared weights of every bin, or empty if every weight was 1
+         * @param nEntries The number of entries
+         * @param resource The memory resource used for the bin contents
+         */
+        Histogram(
+            std::vector<std::unique_ptr<IAxis>> &&axes,
+            const std::vector<STORAGE> &counts,
+            const std::vector<STORAGE> &sumW2,
+            std::size_t nEntries,
+            std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
         template <typename... AXES>
         static Histogram create(const AXES &... axes)
@@ -114,19 +258,124 @@ namespace H5Histograms
 
         H5::DataType h5DType() const override;
         void writeBuffer(void *buffer) const override;
+        std::string dtypeKey() const override;
+        void writeBufferWithDType(void *buffer, const H5::DataType &dtype) const override;
+
+        /**
+         * @brief Write the histogram as a group with its bins in chunked, compressed datasets
+         * 
+         * @param location Where to create the group
+         * @param name The name of the group
+         * @param layout How to chunk and compress the bins
+         * 
+         * See ChunkedLayout for what the group holds. Read it back with read
+         */
+        void writeChunked(H5::Group &location, const std::string &name, const ChunkedLayout &layout = {}) const;
+
+        /// The number of bins in each block whose changes are tracked if not given
+        static constexpr std::size_t defaultBlockBins = 1024;
+
+        /**
+         * @brief Start recording which bins change, so that writeCheckpoint only writes those
+         * 
+         * @param blockBins Changes are recorded for blocks of this many bins in the storage, which
+         *                  must be a power of 2
+         * 
+         * Changes made before this are not recorded. Recording costs one flag per block, set on
+         * each fill
+         */
+        void trackChanges(std::size_t blockBins = defaultBlockBins);
+
+        /// Whether changes to the bins are recorded, see trackChanges
+        bool tracksChanges() const { return !m_changed.empty(); }
+
+        /// Forget the recorded changes
+        void clearChanges();
+
+        /**
+         * @brief Write an incremental checkpoint to a group written by writeChunked
+         * 
+         * @param location Where the group is
+         * @param name The name of the group
+         * @param layout How to chunk and compress the bins
+         * 
+         * If changes are tracked and the group already holds an earlier checkpoint of this
+         * histogram only the blocks that changed since then are appended to it, see
+         * ChunkedLayout. Otherwise, or if the axes have been extended, or once the deltas would
+         * hold as many bins as the histogram, the group is replaced by a fresh writeChunked.
+         * Either way the recorded changes are cleared. Read the latest state back with read.
+         *
+         * A new group is written next to the old one and only replaces it once complete, so if
+         * writing is interrupted read still finds a complete checkpoint, see ChunkedLayout.
+         */
+        void writeCheckpoint(H5::Group &location, const std::string &name, const ChunkedLayout &layout = {});
 
         void fill(const value_t &values, STORAGE weight = 1);
 
-        STORAGE &contents(const index_t &indices);
+        /**
+         * @brief Fill the histogram from one non-owning value per axis
+         * 
+         * @param values The values, one per axis
+         * @param nValues The number of values provided
+         * @param weight The weight to fill with
+         * 
+         * No heap allocations are made unless an axis has to be extended
+         */
+        void fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight = 1);
+
+        /// Fill the histogram from a fixed-size array of values, e.g. fill(makeValues(pt, "ttbar"))
+        template <std::size_t N>
+        void fill(const std::array<IAxis::value_view_t, N> &values, STORAGE weight = 1)
+        {
+            fill(values.data(), N, weight);
+        }
+
+        /**
+         * @brief Fill the histogram from columns of values
+         * 
+         * @param columns One column per axis, each holding nEvents values
+         * @param nEvents The number of events to fill
+         * @param weights nEvents weights or nullptr to fill each event with unit weight
+         * 
+         * Offsets are calculated a block of events at a time, one axis after another, and only
+         * events that need an axis to be extended fall back to the single event fill
+         */
+        void fillColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t nEvents,
+            const STORAGE *weights = nullptr);
+
+        /**
+         * @brief Resolve a category on one of the axes to a token that can be filled in its place
+         * 
+         * @param idx The index of the category axis
+         * @param category The category
+         * 
+         * If the axis is extendable and does not have the category yet it is extended first
+         */
+        IAxis::CategoryToken token(std::size_t idx, const std::string &category);
+
+        BinReference<false> contents(const index_t &indices);
 
         STORAGE contents(const index_t &indices) const;
 
-        STORAGE &sumW2(const index_t &indices);
+        /// Writing through the reference stores the sum of squared weights separately, see isWeighted
+        BinReference<true> sumW2(const index_t &indices);
 
         STORAGE sumW2(const index_t &indices) const;
 
         std::size_t nEntries() const { return m_nEntries; }
 
+        /**
+         * @brief Whether the sum of squared weights is stored separately from the counts
+         * 
+         * Until the histogram is filled with a weight other than 1 the sum of squared weights is
+         * the same as the counts so no separate array is kept and none is written out. Writing a
+         * sumW2 through an iterator or reference also creates the separate array.
+         */
+        bool isWeighted() const { return m_weighted; }
+
+        /// Non-const iterators dereference to BinReferences so only bins that are written change
         iterator begin() { return iterator(*this); }
 
         iterator end() { return iterator::createEnd(*this); }
@@ -135,13 +384,269 @@ namespace H5Histograms
 
         const_iterator end() const { return const_iterator::createEnd(*this); }
 
-        Histogram &operator+=(const Histogram &h);
+        /**
+         * @brief Add another histogram to this one
+         * 
+         * Every axis of this histogram must already hold all of the bins of the other, see merge.
+         * When both have the same binning the bin contents are added directly
+         */
+        Histogram &operator+=(const Histogram &h) { return add(h, 1); }
+
+        /**
+         * @brief Add another histogram to this one, see operator+=
+         * 
+         * @param h The histogram to add
+         * @param nThreads The most threads, including this one, to split the bins between when
+         *                 both have the same binning. Each thread is given at least a million bins
+         * 
+         * Only use more than one thread from the top level, not from threads that are already
+         * sharing out work
+         */
+        Histogram &add(const Histogram &h, std::size_t nThreads);
+
+        /// Add a sparse histogram to this one, see operator+=
+        Histogram &operator+=(const SparseHistogram<STORAGE> &h);
+
+        /**
+         * @brief Add a written dense histogram to this one, reading its bins in place
+         * 
+         * Bins of another type are converted as they are added, see operator+=
+         */
+        Histogram &operator+=(const WrittenBins &h);
+
+        /**
+         * @brief Prepare to add a histogram in parts, see addPart
+         * 
+         * Checks that every bin of h fits and, if h is weighted, stores the sumW2 separately. Only
+         * the latter changes the storage so this can run while other threads are adding parts of
+         * earlier histograms as long as this histogram is already weighted or h is not
+         */
+        void prepareToAdd(const WrittenBins &h);
+
+        /// Prepare to add a sparse histogram in parts, see prepareToAdd
+        void prepareToAdd(const SparseHistogram<STORAGE> &h);
+
+        /**
+         * @brief Add one part of a histogram so that several threads can add it together
+         * 
+         * @param h The histogram, which must have been passed to prepareToAdd
+         * @param part Which part to add
+         * @param nParts The number of parts
+         * 
+         * The rows of this histogram (the bins that differ only along the innermost axis) are
+         * split into nParts blocks, so threads adding different parts never touch the same bin.
+         * The entries of h are added along with part 0
+         */
+        void addPart(const WrittenBins &h, std::size_t part, std::size_t nParts);
+
+        /// Add one part of a sparse histogram, see addPart
+        void addPart(const SparseHistogram<STORAGE> &h, std::size_t part, std::size_t nParts);
+
+        /**
+         * @brief Copy the bins in a region into a new, smaller histogram
+         * 
+         * @param ranges The range of bin offsets to keep along each axis, including flow bins
+         * 
+         * Flow bins of the new axes that are outside of the region are empty. The number of
+         * entries is that of the whole histogram as the entries in the region are not known
+         */
+        Histogram slice(const std::vector<bin_range_t> &ranges) const;
+
+        /**
+         * @brief Add another histogram to this one, first extending the axes to cover its bins
+         * 
+         * Allows adding histograms whose extendable axes have grown differently
+         */
+        Histogram &merge(const Histogram &h);
+
+        /**
+         * @brief Copy this histogram into another, reusing its storage
+         * 
+         * The bins are copied as they are laid out, headroom included, so unless they have
+         * outgrown the target only the axes are allocated. Repeatedly copying into the same
+         * histogram, e.g. to checkpoint it, costs little more than a memcpy of the bins.
+         * The recorded changes are copied too, clear them here if the copy is to write them
+         */
+        void copyInto(Histogram &target) const;
     private:
+        /**
+         * @brief Move the bins to match axes which have been extended
+         *
+         * If every axis was shifted into the headroom already reserved in the storage only the
+         * storage layout is updated. Otherwise the storage is reallocated, reserving headroom
+         * of half the new axis size on each side that grew so that an axis growing steadily in
+         * one direction is only reallocated a logarithmic number of times.
+         */
         void resize(const std::vector<IAxis::ExtensionInfo> &axisExtensions);
 
+        /// Lay out the storage exactly as the axes, with no headroom
+        void resetStorage();
+
+        /// The storage offset of a bin from its axis offsets, or SIZE_MAX if it does not exist
+        std::size_t storageOffset(const std::vector<std::size_t> &axisOffsets) const;
+
+        /// Read the axes and number of entries written by writeChunked, no bins are allocated
+        static Histogram readHeader(const H5::Group &group, std::pmr::memory_resource *resource);
+
+        /// Read the bins of a histogram in a region, chosen once its axes are known
+        static Histogram readRegion(
+            const H5::Group &location,
+            const std::string &name,
+            const std::function<std::vector<bin_range_t>(const HistogramBase &)> &region,
+            std::pmr::memory_resource *resource);
+
+        /**
+         * @brief Select the counts or sumW2 of a block of bins in the storage
+         * 
+         * @param sumW2 Whether to select the sumW2 rather than the counts
+         * @param first The axis offsets of the first bin in the block
+         * @param count The number of bins along each axis of the block
+         * 
+         * The storage is described as an array shaped like it with an extra innermost axis
+         * holding the count and, for weighted histograms, the sumW2 of each bin
+         */
+        H5::DataSpace storageSpace(
+            bool sumW2, const std::vector<std::size_t> &first, const std::vector<std::size_t> &count) const;
+
+        /**
+         * @brief Read a block of bins from one of the datasets written by writeChunked
+         * 
+         * @param dataSet The dataset
+         * @param sumW2 Whether it holds the sumW2 rather than the counts
+         * @param nBins The number of bins the dataset should hold
+         * @param fileFirst The position in the dataset of the first bin in the block
+         * @param first The axis offsets in this histogram of the first bin in the block
+         * @param count The number of bins along each axis of the block
+         */
+        void readBins(
+            const H5::DataSet &dataSet,
+            bool sumW2,
+            std::size_t nBins,
+            const std::vector<std::size_t> &fileFirst,
+            const std::vector<std::size_t> &first,
+            const std::vector<std::size_t> &count);
+
+        /// Whether the storage holds headroom around the axes
+        bool hasHeadroom() const { return m_storage.nEntries() != fullNBins(); }
+
+        /// Record that the bin at a storage offset changed, if changes are tracked
+        void markChanged(std::size_t offset)
+        {
+            if (!m_changed.empty())
+                m_changed[offset >> m_blockShift] = 1;
+        }
+
+        /// Record that the bins in a range [first, last) of storage offsets changed
+        void markChanged(std::size_t first, std::size_t last);
+
+        /// Append the bins in the changed blocks to the deltas in a group written by writeChunked
+        void writeDelta(H5::Group &group, const ChunkedLayout &layout) const;
+
+        /**
+         * @brief Overwrite bins with the deltas written to a group by writeCheckpoint
+         * 
+         * @param group The group
+         * @param fileIndexer The layout of the bins written in the group
+         * @param ranges The region held by this histogram if it was read with readRegion, else nullptr
+         * @param offsets The offset of the start of the region along each axis, see sliceAxes
+         */
+        void applyDeltas(
+            const H5::Group &group,
+            const ArrayIndexer &fileIndexer,
+            const std::vector<bin_range_t> *ranges,
+            const std::vector<std::size_t> &offsets);
+
+        /// Start storing the sum of squared weights separately from the counts
+        void makeWeighted();
+
+        /// Interleave the sum of squared weights with the counts, which are all that m_values holds
+        void interleave(const std::vector<STORAGE> &sumW2);
+
+        /**
+         * @brief Add the bins of another array, converting them to STORAGE
+         * 
+         * @param sizes The number of bins along each axis of the source
+         * @param strides The strides of the source, in bins
+         * @param base The offset in the source of its first bin
+         * @param extensions How each axis of the source maps onto this histogram
+         * @param counts The source counts
+         * @param sumW2 The source sumW2 or nullptr if it is the same as the counts
+         * @param step The distance between neighbouring bins in the source arrays
+         * @param rows Only bins in this range of storage rows are added
+         */
+        template <typename T>
+        void addBins(
+            const std::vector<std::size_t> &sizes,
+            const std::vector<std::size_t> &strides,
+            std::size_t base,
+            const std::vector<IAxis::ExtensionInfo> &extensions,
+            const T *counts,
+            const T *sumW2,
+            std::size_t step,
+            std::pair<std::size_t, std::size_t> rows = {0, SIZE_MAX});
+
+        /// The number of bins in each row of the storage
+        std::size_t storageRowSize() const { return nDims() > 0 ? std::max<std::size_t>(m_storage.axisSizes().back(), 1) : 1; }
+
+        /// The range of storage rows in one of nParts parts, see addPart
+        std::pair<std::size_t, std::size_t> partRows(std::size_t part, std::size_t nParts) const;
+
+        /// Get the storage offset from indices, throwing if it does not exist
+        std::size_t checkedOffset(const index_t &indices) const;
+
+        // The remaining accessors take storage offsets
+
+        STORAGE &countAt(std::size_t offset) { return m_values[m_weighted ? 2 * offset : offset]; }
+
+        const STORAGE &countAt(std::size_t offset) const { return m_values[m_weighted ? 2 * offset : offset]; }
+
+        /// For unweighted histograms this is the count
+        STORAGE &sumW2At(std::size_t offset) { return m_values[m_weighted ? 2 * offset + 1 : offset]; }
+
+        const STORAGE &sumW2At(std::size_t offset) const { return m_values[m_weighted ? 2 * offset + 1 : offset]; }
+
+        /// Add to a bin
+        void add(std::size_t offset, STORAGE weight)
+        {
+            markChanged(offset);
+            if (weight != 1 && !m_weighted)
+                makeWeighted();
+            if (m_weighted)
+            {
+                m_values[2 * offset] += weight;
+                m_values[2 * offset + 1] += weight * weight;
+            }
+            else
+                m_values[offset] += weight;
+        }
+
+        bool m_weighted;
         std::size_t m_nEntries;
-        std::vector<STORAGE> m_counts;
-        std::vector<STORAGE> m_sumW2;
+        /**
+         * @brief The bin contents
+         * 
+         * Unweighted histograms only hold the counts. Weighted histograms hold each bin's count
+         * followed by its sumW2 so that a fill only touches one cache line. All allocations,
+         * including when the axes are extended, use the memory resource given on construction
+         */
+        std::pmr::vector<STORAGE> m_values;
+        /**
+         * @brief The layout of the storage, which may be larger than the axes along each axis
+         * 
+         * Extendable axes are given headroom when they grow so the axes themselves keep their
+         * exact ranges while later extensions into the headroom do not move any bins
+         */
+        ArrayIndexer m_storage;
+        /// The position in the storage of the first bin along each axis
+        std::vector<std::size_t> m_origins;
+        /// The storage offset of the first bin
+        std::size_t m_base;
+        /// One flag per block of bins in the storage, set when any of them changes. Empty unless changes are tracked
+        std::vector<unsigned char> m_changed;
+        /// The log2 of the number of bins in each block
+        std::size_t m_blockShift{0};
+        /// Whether the axes were extended since the changes were last cleared, which moves every bin
+        bool m_axesChanged{false};
     }; //> end class Histogram<STORAGE>
 
     using IntHistogram = Histogram<int>;
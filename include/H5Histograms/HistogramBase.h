@@ -17,8 +17,12 @@
 #include "H5Histograms/IAxis.h"
 #include "H5Composites/MergeFactory.h"
 
+#include <array>
 #include <vector>
 #include <memory>
+#include <string_view>
+#include <type_traits>
+#include <variant>
 
 namespace H5Histograms
 {
@@ -29,14 +33,121 @@ namespace H5Histograms
         H5COMPOSITES_DECLARE_MERGE()
         using value_t = std::vector<IAxis::value_t>;
         using index_t = std::vector<IAxis::index_t>;
+        /// A range [first, last) of bin offsets along one axis
+        using bin_range_t = std::pair<std::size_t, std::size_t>;
         HistogramBase(std::vector<std::unique_ptr<IAxis>> &&axes);
 
+        /// A pointer to an array of bins of any of the supported storage types
+        using bins_ptr_t = std::variant<
+            const int *,
+            const unsigned int *,
+            const char *,
+            const signed char *,
+            const unsigned char *,
+            const short *,
+            const unsigned short *,
+            const long *,
+            const long long *,
+            const unsigned long *,
+            const unsigned long long *,
+            const float *,
+            const double *>;
+
+        /**
+         * @brief The bins of a written dense histogram, read in place from its buffer
+         *
+         * Only the axes are copied out so the buffer must outlive this. Creating one calls HDF5
+         * but reading the bins afterwards does not, so that can happen on any thread. Bins that
+         * were not written with a native type, or are not aligned for it, are converted to double
+         * and held here instead.
+         */
+        struct WrittenBins
+        {
+            WrittenBins(const void *buffer, const H5::DataType &dtype);
+
+            std::vector<std::unique_ptr<IAxis>> axes;
+            std::size_t nEntries;
+            /// The layout of the bins, written histograms have no headroom
+            ArrayIndexer indexer;
+            bins_ptr_t counts;
+            /// Points to the same type as the counts, a null pointer if the histogram is unweighted
+            bins_ptr_t sumW2;
+            /// Only used if the bins had to be converted
+            std::vector<double> converted;
+
+            /// Whether the sumW2 was written separately from the counts
+            bool isWeighted() const
+            {
+                return std::visit([](auto ptr) { return ptr != nullptr; }, sumW2);
+            }
+        };
+
         static std::string registeredName() { return "H5Histograms::Histogram"; }
 
+        /// The number of inputs that mergeBuffers holds in flight if not told otherwise
+        static constexpr std::size_t defaultMergeInFlight = 4;
+
+        /**
+         * @brief Limit the threads and memory used by mergeBuffers
+         * 
+         * @param nThreads The number of threads adding inputs, 0 for one per core
+         * @param nInFlight The most inputs that have been read but not yet added
+         * 
+         * Dense merges hold a single output histogram whatever the number of threads, each
+         * thread adds its own block of rows from every input. Sparse merges keep one partial sum
+         * per thread. Dense inputs are read in place so only cost memory if their bins have to be
+         * converted.
+         */
+        static void setMergeLimits(std::size_t nThreads, std::size_t nInFlight = defaultMergeInFlight);
+
+        /// The native HDF5 type of one of the supported storage types
+        template <typename T>
+        static const H5::PredType &nativeDType()
+        {
+            if constexpr (std::is_same_v<T, char>)
+                return H5::PredType::NATIVE_CHAR;
+            else if constexpr (std::is_same_v<T, signed char>)
+                return H5::PredType::NATIVE_SCHAR;
+            else if constexpr (std::is_same_v<T, unsigned char>)
+                return H5::PredType::NATIVE_UCHAR;
+            else if constexpr (std::is_same_v<T, short>)
+                return H5::PredType::NATIVE_SHORT;
+            else if constexpr (std::is_same_v<T, unsigned short>)
+                return H5::PredType::NATIVE_USHORT;
+            else if constexpr (std::is_same_v<T, int>)
+                return H5::PredType::NATIVE_INT;
+            else if constexpr (std::is_same_v<T, unsigned int>)
+                return H5::PredType::NATIVE_UINT;
+            else if constexpr (std::is_same_v<T, long>)
+                return H5::PredType::NATIVE_LONG;
+            else if constexpr (std::is_same_v<T, unsigned long>)
+                return H5::PredType::NATIVE_ULONG;
+            else if constexpr (std::is_same_v<T, long long>)
+                return H5::PredType::NATIVE_LLONG;
+            else if constexpr (std::is_same_v<T, unsigned long long>)
+                return H5::PredType::NATIVE_ULLONG;
+            else if constexpr (std::is_same_v<T, float>)
+                return H5::PredType::NATIVE_FLOAT;
+            else
+            {
+                static_assert(std::is_same_v<T, double>, "Unsupported storage type");
+                return H5::PredType::NATIVE_DOUBLE;
+            }
+        }
+
+        /// Whether a written histogram has the sumW2 member, unweighted histograms omit it
+        static bool storesSumW2(const H5::DataType &dtype);
+
+        /// Whether a written histogram was a SparseHistogram, which stores its filled bins' coordinates
+        static bool isSparse(const H5::DataType &dtype);
+
         std::size_t nDims() const;
 
         const IAxis &axis(std::size_t idx) const;
 
+        /// Copy the axes of this histogram, e.g. to create an empty histogram with the same binning
+        std::vector<std::unique_ptr<IAxis>> cloneAxes() const;
+
         std::vector<IAxis::index_t> findBin(const value_t &values) const;
 
         std::vector<std::size_t> axisOffsetsFromValues(const value_t &values) const;
@@ -47,17 +158,179 @@ namespace H5Histograms
 
         std::size_t binOffsetFromIndices(const index_t &values) const;
 
+        /**
+         * @brief Get the offset of a bin from one non-owning value per axis
+         * 
+         * @param values The values, one per axis
+         * @param nValues The number of values provided
+         * @return The bin offset or SIZE_MAX if no bin exists for these values
+         * 
+         * Unlike the value_t overload this performs no heap allocations
+         */
+        std::size_t binOffsetFromValues(const IAxis::value_view_t *values, std::size_t nValues) const;
+
+        template <std::size_t N>
+        std::size_t binOffsetFromValues(const std::array<IAxis::value_view_t, N> &values) const
+        {
+            return binOffsetFromValues(values.data(), N);
+        }
+
+        /**
+         * @brief Get the bin offsets for a block of events stored in columns
+         * 
+         * @param columns One column per axis
+         * @param first The position in the columns of the first event in the block
+         * @param n The number of events in the block
+         * @param[out] offsets The bin offset for each event, SIZE_MAX where no bin exists
+         * @param scratch Working space for n axis offsets
+         */
+        void binOffsetsFromColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t first,
+            std::size_t n,
+            std::size_t *offsets,
+            std::size_t *scratch) const;
+
+        /**
+         * @brief Build a fixed-size array of non-owning values from numbers and strings
+         * 
+         * e.g. makeValues(pt, "ttbar"). Strings are not copied so must outlive the returned array
+         */
+        template <typename... VALUES>
+        static std::array<IAxis::value_view_t, sizeof...(VALUES)> makeValues(const VALUES &... values)
+        {
+            return {makeValue(values)...};
+        }
+
         bool contains(const value_t &values) const;
 
+        /**
+         * @brief A key identifying the data type this histogram is written with
+         *
+         * Histograms with the same key have the same h5DType, so a writer can build the data type
+         * once and reuse it through writeBufferWithDType
+         */
+        virtual std::string dtypeKey() const;
+
+        /**
+         * @brief Write the histogram using the data type of another with the same dtypeKey
+         *
+         * For small histograms building the data type costs more than writing them, so this skips it
+         */
+        virtual void writeBufferWithDType(void *buffer, const H5::DataType &dtype) const;
+
+        /**
+         * @brief Get the ranges of bins along each axis that cover a box of values
+         * 
+         * @param box The lowest and highest value along each axis, both of which are included
+         * 
+         * Throws std::out_of_range if an axis has no bin for one of the values
+         */
+        std::vector<bin_range_t> binRanges(const std::vector<std::pair<IAxis::value_t, IAxis::value_t>> &box) const;
+
         std::size_t nBins() const;
 
         std::size_t fullNBins() const;
 
     protected:
+        template <typename T>
+        static IAxis::value_view_t makeValue(const T &value)
+        {
+            if constexpr (std::is_same_v<T, IAxis::CategoryToken>)
+                return value;
+            else if constexpr (std::is_arithmetic_v<T>)
+                return static_cast<double>(value);
+            else
+                return std::string_view(value);
+        }
+
+        /// Get the offset of a bin in an array laid out with the given strides, see binOffsetFromValues
+        std::size_t binOffsetFromValues(
+            const IAxis::value_view_t *values,
+            std::size_t nValues,
+            const std::vector<std::size_t> &strides) const;
+
+        /// Get the offsets of a block of events in an array laid out with the given strides, see binOffsetsFromColumns
+        void binOffsetsFromColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t first,
+            std::size_t n,
+            std::size_t *offsets,
+            std::size_t *scratch,
+            const std::vector<std::size_t> &strides) const;
+
+        /// Convert non-owning values into the owning form
+        value_t ownedValues(const IAxis::value_view_t *values, std::size_t nValues) const;
+
+        /// Get the values of a single event from columns
+        value_t valuesFromColumns(const std::vector<IAxis::column_t> &columns, std::size_t idx) const;
+
         void calculateStrides();
 
         std::vector<IAxis::ExtensionInfo> extendAxes(const value_t &values, std::size_t &offset);
 
+        /// Extend a single axis to contain a value, the others are left unchanged
+        std::vector<IAxis::ExtensionInfo> extendAxis(std::size_t idx, const IAxis::value_t &value);
+
+        /// Compare each axis to the matching axis of another histogram, see IAxis::compareAxis
+        std::vector<IAxis::ExtensionInfo> compareAxes(const HistogramBase &other) const;
+
+        /**
+         * @brief Slice each axis to a range of its bins, see IAxis::slice
+         * 
+         * @param axes The axes to slice
+         * @param ranges The range of bins to keep along each axis
+         * @param[out] offsets The offset of the first kept bin in each new axis
+         */
+        static std::vector<std::unique_ptr<IAxis>> sliceAxes(
+            const std::vector<std::unique_ptr<IAxis>> &axes,
+            const std::vector<bin_range_t> &ranges,
+            std::vector<std::size_t> &offsets);
+
+        /**
+         * @brief Map a bin offset from one binning to another
+         * 
+         * @param offset The bin offset in the original binning
+         * @param from The indexer for the original binning
+         * @param to The indexer for the new binning
+         * @param extensions How each axis maps onto its new binning
+         */
+        static std::size_t mapOffset(
+            std::size_t offset,
+            const ArrayIndexer &from,
+            const ArrayIndexer &to,
+            const std::vector<IAxis::ExtensionInfo> &extensions);
+
+        /**
+         * @brief Create the data type of a histogram whose bin contents are written by hand
+         * 
+         * @param header The data type of the other members
+         * @param element The type of each bin
+         * @param weighted Whether to include the sumW2 member
+         * 
+         * The counts, and if requested the sumW2, arrays follow the header members, padded to the
+         * alignment of the element type
+         */
+        H5::CompType appendBinArrays(const H5::DataType &header, const H5::DataType &element, bool weighted) const;
+
+        /**
+         * @brief Read one of the bin arrays of a written histogram
+         * 
+         * @param buffer The written histogram
+         * @param dtype Its data type
+         * @param name The name of the array member
+         * @param memType The type to convert each bin to
+         * @param[out] out Space for n bins of memType
+         * @param n The expected number of bins
+         */
+        static void readBinArray(
+            const void *buffer,
+            const H5::DataType &dtype,
+            const std::string &name,
+            const H5::DataType &memType,
+            void *out,
+            std::size_t n);
+
         std::vector<std::unique_ptr<IAxis>> m_axes;
         ArrayIndexer m_indexer;
     }; //> end class HistogramBase
@@ -0,0 +1,142 @@
+/**
+ * @file HistogramView.h
+ * @author Jon Burr
+ * @brief Read-only view of a written histogram
+ * @version 0.0.0
+ * @date 2022-01-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_HISTOGRAMVIEW_H
+#define H5HISTOGRAMS_HISTOGRAMVIEW_H
+
+#include "H5Histograms/HistogramBase.h"
+#include "H5Composites/H5Buffer.h"
+
+#include <iterator>
+#include <tuple>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Read-only view of a written dense histogram, reading its bins in place
+     *
+     * Only the axes are copied out of the buffer so opening even a very large histogram is cheap.
+     * The buffer can be an H5Buffer or any other memory holding the written histogram, e.g. the
+     * memory-mapped region of a file holding a contiguous, unfiltered dataset, and must outlive
+     * the view. The contents are returned as double whatever type they were written with. Bins
+     * that are not aligned for their type, e.g. in a file mapped at an unaligned dataset offset,
+     * cannot be read in place so are copied out and converted when the view is opened.
+     *
+     * Writing the view copies the buffer it views so it can be passed on without reading the bins.
+     */
+    class HistogramView : public HistogramBase
+    {
+    public:
+        /// Iterates over every bin, including the flow bins
+        class const_iterator
+        {
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::tuple<double, double>;
+            using pointer = const value_type *;
+            using reference = value_type;
+            using iterator_category = std::forward_iterator_tag;
+
+            const_iterator(const HistogramView &view, std::size_t offset)
+                : m_view(view), m_offset(offset) {}
+
+            /// The contents and sumW2 of the bin pointed to
+            reference operator*() const { return {contents(), sumW2()}; }
+
+            /// The offset of the bin pointed to
+            std::size_t offset() const { return m_offset; }
+
+            /// Get the current bin indices
+            HistogramBase::index_t indices() const;
+
+            /// Get the contents of the bin pointed to
+            double contents() const { return m_view.countAt(m_offset); }
+
+            /// Get the sumW2 of the bin pointed to
+            double sumW2() const { return m_view.sumW2At(m_offset); }
+
+            bool operator==(const const_iterator &other) const
+            {
+                return &m_view == &other.m_view && m_offset == other.m_offset;
+            }
+
+            bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+            const_iterator &operator++()
+            {
+                ++m_offset;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const_iterator itr = *this;
+                ++*this;
+                return itr;
+            }
+
+        private:
+            const HistogramView &m_view;
+            std::size_t m_offset;
+        };
+
+        /**
+         * @brief View a written histogram
+         *
+         * @param buffer The written histogram, which must outlive the view
+         * @param dtype Its data type
+         */
+        HistogramView(const void *buffer, const H5::DataType &dtype);
+
+        /// View a histogram held in an H5Buffer, which must outlive the view
+        HistogramView(const H5Composites::H5Buffer &buffer);
+
+        H5::DataType h5DType() const override;
+        void writeBuffer(void *buffer) const override;
+        std::string dtypeKey() const override;
+        void writeBufferWithDType(void *buffer, const H5::DataType &dtype) const override;
+
+        double contents(const index_t &indices) const;
+
+        double sumW2(const index_t &indices) const;
+
+        std::size_t nEntries() const { return m_nEntries; }
+
+        /// Whether the sum of squared weights was written separately from the counts
+        bool isWeighted() const { return m_weighted; }
+
+        const_iterator begin() const { return const_iterator(*this, 0); }
+
+        const_iterator end() const { return const_iterator(*this, fullNBins()); }
+
+    private:
+        HistogramView(WrittenBins &&bins, const void *buffer, const H5::DataType &dtype);
+
+        /// Get the bin offset from indices, throwing if it does not exist
+        std::size_t checkedOffset(const index_t &indices) const;
+
+        double countAt(std::size_t offset) const;
+
+        /// For unweighted histograms this is the count
+        double sumW2At(std::size_t offset) const;
+
+        const void *m_buffer;
+        H5::DataType m_dtype;
+        std::size_t m_nEntries;
+        bool m_weighted;
+        bins_ptr_t m_counts;
+        bins_ptr_t m_sumW2;
+        /// Only used if the bins had to be converted, moving it keeps them where they are pointed to
+        std::vector<double> m_converted;
+    }; //> end class HistogramView
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_HISTOGRAMVIEW_H
@@ -0,0 +1,143 @@
+/**
+ * @file HistogramWriter.h
+ * @author Jon Burr
+ * @brief Buffered writing of many histograms
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_HISTOGRAMWRITER_H
+#define H5HISTOGRAMS_HISTOGRAMWRITER_H
+
+#include "H5Histograms/HistogramBase.h"
+#include "H5Cpp.h"
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Write many histograms to a group, batching those with the same data type
+     *
+     * Writing every histogram to its own dataset costs a data type, a dataset and a write call
+     * each, which for small histograms is far more than writing their contents. Instead each
+     * histogram is written into a memory buffer shared with all the others that have the same
+     * dtypeKey, whose data type is only built once. Once enough has been buffered every batch is
+     * appended to its own extendable dataset ("batch0", "batch1", ...) in one write.
+     *
+     * An "index" dataset records the batch and row of each histogram by name, use readBuffer to
+     * read one back.
+     */
+    class HistogramWriter
+    {
+    public:
+        /// The batch and row of each written histogram by name, see readIndex
+        using index_t = std::unordered_map<std::string, std::pair<unsigned int, hsize_t>>;
+
+        /// The name of the dataset recording where each histogram was written
+        static const std::string indexName;
+
+        /// The prefix of the names of the batch datasets
+        static const std::string batchPrefix;
+
+        /// The amount buffered before it is written out if not given
+        static constexpr std::size_t defaultBufferBytes = std::size_t(64) << 20;
+
+        /**
+         * @brief Create the writer
+         *
+         * @param location The group to write to, which must not already hold an index
+         * @param bufferBytes The amount to buffer before writing it out
+         */
+        HistogramWriter(const H5::Group &location, std::size_t bufferBytes = defaultBufferBytes);
+
+        /// Writes out anything still buffered, call flush first to see any errors
+        ~HistogramWriter();
+
+        HistogramWriter(const HistogramWriter &) = delete;
+        HistogramWriter &operator=(const HistogramWriter &) = delete;
+
+        /**
+         * @brief Buffer a histogram to be written
+         *
+         * @param name The name to read the histogram back with
+         * @param histogram The histogram, which is copied so can be changed afterwards
+         *
+         * Throws std::invalid_argument if a histogram was already written with that name
+         */
+        void write(const std::string &name, const HistogramBase &histogram);
+
+        /// Write out everything buffered
+        void flush();
+
+        /// The number of histograms written or buffered
+        std::size_t size() const { return m_nIndexed + m_pendingNames.size(); }
+
+        /**
+         * @brief Read back a single histogram written by a HistogramWriter
+         *
+         * @param location The group it was written to
+         * @param name The name it was written with
+         * @param[out] dtype The data type of the histogram
+         * @return The written histogram
+         *
+         * Throws std::out_of_range if no histogram was written with that name. The whole index is
+         * read and searched for every call, to read back many histograms use readIndex once and
+         * pass the result to the other overload
+         */
+        static std::vector<char> readBuffer(const H5::Group &location, const std::string &name, H5::DataType &dtype);
+
+        /// Read the index written to a group by a HistogramWriter
+        static index_t readIndex(const H5::Group &location);
+
+        /// Read back a single histogram using an index already read with readIndex
+        static std::vector<char> readBuffer(
+            const H5::Group &location, const index_t &index, const std::string &name, H5::DataType &dtype);
+
+    private:
+        /// The histograms sharing a single data type
+        struct Batch
+        {
+            H5::DataType dtype;
+            std::size_t size;
+            std::string name;
+            /// Only created when the batch is first written out
+            std::optional<H5::DataSet> dataSet;
+            hsize_t nWritten = 0;
+            std::vector<char> pending;
+        };
+
+        /// Read one row of a batch dataset
+        static std::vector<char> readRow(
+            const H5::Group &location, unsigned int batch, hsize_t row, H5::DataType &dtype);
+
+        /// Append rows to an extendable dataset, creating it if necessary
+        static void append(
+            const H5::Group &location, std::optional<H5::DataSet> &dataSet, const std::string &name,
+            const H5::DataType &dtype, hsize_t nWritten, hsize_t n, const void *buffer);
+
+        H5::Group m_location;
+        std::size_t m_bufferBytes;
+        std::size_t m_pendingBytes{0};
+        std::vector<Batch> m_batches;
+        /// The position in m_batches of the batch for each dtypeKey
+        std::unordered_map<std::string, std::size_t> m_batchIndices;
+        std::optional<H5::DataSet> m_index;
+        hsize_t m_nIndexed{0};
+        /// Every name written or buffered, to reject duplicates
+        std::unordered_set<std::string> m_names;
+        std::vector<std::string> m_pendingNames;
+        std::vector<unsigned int> m_pendingBatches;
+        std::vector<hsize_t> m_pendingRows;
+    }; //> end class HistogramWriter
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_HISTOGRAMWRITER_H
@@ -19,10 +19,12 @@
 #include "H5Composites/BufferWriteTraits.h"
 #include "H5Composites/MergeFactory.h"
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 #include <map>
 #include <functional>
+#include <memory>
 
 namespace H5Histograms
 {
@@ -31,6 +33,20 @@ namespace H5Histograms
     public:
         using index_t = std::variant<std::string, std::size_t>;
         using value_t = std::variant<std::string, double>;
+        /**
+         * @brief A category that has already been resolved to its bin offset
+         * 
+         * Created by CategoryAxis::token. As extending an axis never moves existing bins, a token
+         * stays valid for the lifetime of the axis it was created from
+         */
+        struct CategoryToken
+        {
+            std::size_t offset;
+        };
+        /// Non-owning equivalent of value_t, used by the allocation-free fill and lookup paths
+        using value_view_t = std::variant<std::string_view, double, CategoryToken>;
+        /// A contiguous column of values for one axis, used by the batched fill
+        using column_t = std::variant<const std::string *, const double *, const CategoryToken *>;
         /**
          * @brief The type of data stored along the axis
          */
@@ -41,17 +57,42 @@ namespace H5Histograms
         };
         /**
          * @brief Hold information about axis extensions
+         *
+         * Describes where each of the old bins ends up, either by moving every bin by the same
+         * amount or through a table with one entry per old bin. Keeping this as plain data allows
+         * whole rows of bins to be copied at once when every bin moves together.
          */
         struct ExtensionInfo
         {
-            std::function<std::size_t(std::size_t)> func;
             std::size_t oldNBins;
+            /// The amount by which every bin moves, or SIZE_MAX if they are mapped through the table
+            std::size_t shift;
+            /// The new offset of each old bin, only used when the bins do not all move together
+            std::vector<std::size_t> table;
+
+            /// Whether every bin moves by the same amount
+            bool isShift() const { return shift != SIZE_MAX; }
+
+            /// The new offset of an old bin
+            std::size_t newOffset(std::size_t oldOffset) const
+            {
+                return isShift() ? oldOffset + shift : table[oldOffset];
+            }
+
+            /// Whether every old bin lands inside an axis with this many bins
+            bool fitsInto(std::size_t newNBins) const;
 
             static ExtensionInfo createIdentity(std::size_t oldNBins);
             static ExtensionInfo createShift(std::size_t oldNBins, std::size_t shift=0);
             static ExtensionInfo createMapped(const std::vector<std::size_t> &map);
         };
 
+        /// Create a copy of this axis
+        virtual std::unique_ptr<IAxis> clone() const = 0;
+
+        /// A key identifying the data type of this axis, axes with the same key have the same h5DType
+        virtual std::string dtypeKey() const = 0;
+
         /// The type of this axis
         virtual Type axisType() const = 0;
 
@@ -70,6 +111,80 @@ namespace H5Histograms
         /// Get the offset of a bin from its value
         virtual std::size_t binOffsetFromValue(const value_t &value) const = 0;
 
+        /**
+         * @brief Get the offset of a bin from a numeric value
+         * 
+         * Unlike binOffsetFromValue this does not require constructing a value_t. The default
+         * implementation throws std::invalid_argument, axes holding numeric values must override it
+         */
+        virtual std::size_t binOffsetFromNumeric(double value) const;
+
+        /**
+         * @brief Get the offset of a bin from a category value
+         * 
+         * Unlike binOffsetFromValue this does not require constructing a value_t. The default
+         * implementation throws std::invalid_argument, axes holding categories must override it
+         */
+        virtual std::size_t binOffsetFromCategory(std::string_view value) const;
+
+        /**
+         * @brief Get the offset of a bin from a category token
+         * 
+         * The default implementation throws std::invalid_argument, axes holding categories must
+         * override it
+         */
+        virtual std::size_t binOffsetFromToken(CategoryToken token) const;
+
+        /// Get the offset of a bin from a non-owning value
+        std::size_t binOffsetFromView(const value_view_t &value) const;
+
+        /// Convert a non-owning value into the owning form
+        value_t ownedValue(const value_view_t &value) const;
+
+        /**
+         * @brief Get the offsets of the bins for a block of numeric values
+         * 
+         * @param values The values
+         * @param n The number of values
+         * @param[out] offsets The offset of each value's bin, SIZE_MAX where no such bin exists
+         * 
+         * The default implementation calls binOffsetFromNumeric for each value
+         */
+        virtual void binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const;
+
+        /**
+         * @brief Get the offsets of the bins for a block of category values
+         * 
+         * @param values The values
+         * @param n The number of values
+         * @param[out] offsets The offset of each value's bin, SIZE_MAX where no such bin exists
+         * 
+         * The default implementation calls binOffsetFromCategory for each value
+         */
+        virtual void binOffsetsFromCategory(const std::string *values, std::size_t n, std::size_t *offsets) const;
+
+        /**
+         * @brief Get the offsets of the bins for a block of category tokens
+         * 
+         * @param tokens The tokens
+         * @param n The number of tokens
+         * @param[out] offsets The offset of each token's bin
+         * 
+         * The default implementation calls binOffsetFromToken for each token
+         */
+        virtual void binOffsetsFromTokens(const CategoryToken *tokens, std::size_t n, std::size_t *offsets) const;
+
+        /**
+         * @brief Get the offsets of the bins for a block of a column
+         * 
+         * @param column The column of values
+         * @param first The position in the column of the first value
+         * @param n The number of values
+         * @param[out] offsets The offset of each value's bin, SIZE_MAX where no such bin exists
+         */
+        void binOffsetsFromColumn(
+            const column_t &column, std::size_t first, std::size_t n, std::size_t *offsets) const;
+
         /// Get the offset of a bin from its index
         virtual std::size_t binOffsetFromIndex(const index_t &index) const = 0;
 
@@ -91,6 +206,30 @@ namespace H5Histograms
         virtual ExtensionInfo extendAxis(const value_t &value, std::size_t &offset) = 0;
 
         virtual ExtensionInfo compareAxis(const IAxis &other) const = 0;
+
+        /**
+         * @brief Extend this axis so that it holds every bin of another
+         * 
+         * @param other The axis to merge in
+         * @return How the existing bins of this axis were moved
+         * 
+         * Afterwards compareAxis(other) is valid. Throws std::invalid_argument if the two axes
+         * are not compatible
+         */
+        virtual ExtensionInfo mergeAxis(const IAxis &other) = 0;
+
+        /**
+         * @brief Create an axis holding a contiguous range of the bins of this one
+         * 
+         * @param first The offset of the first bin to keep
+         * @param last One past the offset of the last bin to keep
+         * @param[out] offset The offset in the new axis of the first kept bin
+         * 
+         * The kept bins stay in order. Any flow bins that the new axis has outside of the range
+         * are new, empty bins. Throws std::out_of_range if the range is empty or runs past the end
+         * of the axis
+         */
+        virtual std::unique_ptr<IAxis> slice(std::size_t first, std::size_t last, std::size_t &offset) const = 0;
     }; //> end class IAxis
 
     using IAxisFactory = H5Composites::GenericFactory<IAxis>;
@@ -0,0 +1,111 @@
+/**
+ * @file MemoryResources.h
+ * @author Jon Burr
+ * @brief Memory resources for histogram storage
+ * @version 0.0.0
+ * @date 2022-01-20
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef H5HISTOGRAMS_MEMORYRESOURCES_H
+#define H5HISTOGRAMS_MEMORYRESOURCES_H
+
+#include <memory_resource>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Resource that backs large allocations with transparent huge pages
+     * 
+     * Allocations of at least one huge page are aligned to the huge page size and marked as
+     * huge page candidates, which greatly reduces TLB misses on multi-GB histograms. Smaller
+     * allocations are passed to the upstream resource.
+     */
+    class HugePageResource : public std::pmr::memory_resource
+    {
+    public:
+        /// The huge page size
+        static constexpr std::size_t pageSize = 2 * 1024 * 1024;
+
+        HugePageResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    private:
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+        std::pmr::memory_resource *m_upstream;
+    }; //> end class HugePageResource
+
+    /// Shared huge page resource
+    HugePageResource *hugePageResource();
+
+    /**
+     * @brief Arena that hands out memory from large blocks and frees it all at once
+     * 
+     * Deallocation does nothing. reset makes all of the memory available again while keeping the
+     * blocks, so a merge job that repeatedly creates and destroys temporary histograms stops
+     * allocating once the blocks are large enough.
+     *
+     * The library does not use the arena itself, it is provided for callers to pass as the resource
+     * when constructing or reading their own temporary histograms, e.g.
+     *
+     *     MonotonicArena arena;
+     *     for (const std::string &name : names)
+     *     {
+     *         {
+     *             Histogram<double> h = Histogram<double>::read(group, name, &arena);
+     *             // ... use h ...
+     *         }
+     *         arena.reset();
+     *     }
+     *
+     * Every histogram using the arena must be destroyed before reset is called. The arena is not
+     * thread-safe, so threads filling or reading concurrently each need their own.
+     */
+    class MonotonicArena : public std::pmr::memory_resource
+    {
+    public:
+        /**
+         * @brief Create the arena
+         * 
+         * @param blockSize The minimum size of each block requested from upstream
+         * @param upstream The resource providing the blocks
+         */
+        MonotonicArena(
+            std::size_t blockSize = HugePageResource::pageSize,
+            std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+        ~MonotonicArena();
+
+        MonotonicArena(const MonotonicArena &) = delete;
+        MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+        /// Make all of the memory available again. Nothing allocated from the arena may be used afterwards
+        void reset();
+
+    private:
+        struct Block
+        {
+            char *data;
+            std::size_t size;
+        };
+
+        void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+        std::size_t m_blockSize;
+        std::pmr::memory_resource *m_upstream;
+        std::vector<Block> m_blocks;
+        /// The block currently being allocated from
+        std::size_t m_current;
+        /// The number of bytes used in the current block
+        std::size_t m_used;
+    }; //> end class MonotonicArena
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_MEMORYRESOURCES_H
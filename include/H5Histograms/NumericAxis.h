@@ -9,6 +9,9 @@
  * 
  */
 
+#ifndef H5HISTOGRAMS_NUMERICAXIS_H
+#define H5HISTOGRAMS_NUMERICAXIS_H
+
 #include "H5Histograms/IAxis.h"
 
 namespace H5Histograms
@@ -30,6 +33,12 @@ namespace H5Histograms
         /// Get the offset of a bin from its value
         std::size_t binOffsetFromValue(const IAxis::value_t &value) const override;
 
+        /// Get the offset of a bin from a numeric value
+        std::size_t binOffsetFromNumeric(double value) const override;
+
+        /// Get the index of the bin containing a value. SIZE_MAX if no such bin exists
+        virtual std::size_t findBinIndex(double value) const = 0;
+
         /// Get the offset of a bin from its index
         std::size_t binOffsetFromIndex(const IAxis::index_t &index) const override;
 
@@ -42,4 +51,6 @@ namespace H5Histograms
     protected:
         std::string m_label;
     }; //> end class NumericAxis
-}
\ No newline at end of file
+}
+
+#endif //> !H5HISTOGRAMS_NUMERICAXIS_H
\ No newline at end of file
@@ -0,0 +1,101 @@
+/**
+ * @file ShardedHistogram.h
+ * @author Jon Burr
+ * @brief Histogram that can be filled concurrently from many threads
+ * @version 0.0.0
+ * @date 2022-01-20
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+
+#ifndef H5HISTOGRAMS_SHARDEDHISTOGRAM_H
+#define H5HISTOGRAMS_SHARDEDHISTOGRAM_H
+
+#include "H5Histograms/Histogram.h"
+
+#include <mutex>
+#include <memory>
+#include <vector>
+
+namespace H5Histograms
+{
+    /**
+     * @brief Histogram that can be filled concurrently from many threads
+     * 
+     * Each thread fills its own shard, a full Histogram with the same axes which is created the
+     * first time that thread fills. No locks are taken when filling an existing shard. The shards
+     * are combined with merged or flush, which handle shards whose extendable axes grew
+     * differently. Neither may be called while other threads are filling.
+     */
+    template <typename STORAGE>
+    class ShardedHistogram
+    {
+    public:
+        /**
+         * @brief Create the sharded histogram
+         * 
+         * @param axes The axes that each shard starts from
+         */
+        ShardedHistogram(std::vector<std::unique_ptr<IAxis>> &&axes);
+
+        /// Create a sharded histogram with the same axes as an existing histogram
+        ShardedHistogram(const HistogramBase &prototype);
+
+        /// Marks the threads' cached pointers to the shards as stale so that they are pruned
+        ~ShardedHistogram();
+
+        /// The shard belonging to the calling thread
+        Histogram<STORAGE> &local();
+
+        void fill(const HistogramBase::value_t &values, STORAGE weight = 1)
+        {
+            local().fill(values, weight);
+        }
+
+        template <std::size_t N>
+        void fill(const std::array<IAxis::value_view_t, N> &values, STORAGE weight = 1)
+        {
+            local().fill(values, weight);
+        }
+
+        void fillColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t nEvents,
+            const STORAGE *weights = nullptr)
+        {
+            local().fillColumns(columns, nEvents, weights);
+        }
+
+        /// The number of threads that have filled this histogram
+        std::size_t nShards() const;
+
+        /// Combine all of the shards into a single histogram
+        Histogram<STORAGE> merged() const;
+
+        /// Combine all of the shards into a single histogram and reset them
+        Histogram<STORAGE> flush();
+
+    private:
+        /// Keep each shard on its own cache lines so that threads do not contend on them
+        struct alignas(64) Shard
+        {
+            Shard(std::vector<std::unique_ptr<IAxis>> &&axes) : histogram(std::move(axes)) {}
+            Histogram<STORAGE> histogram;
+        };
+
+        /// Create a new empty histogram with the starting axes
+        Histogram<STORAGE> empty() const;
+
+        /// Copy the starting axes
+        std::vector<std::unique_ptr<IAxis>> cloneAxes() const;
+
+        /// Unique identifier used to find this histogram's shard in the thread local cache
+        const std::size_t m_id;
+        std::vector<std::unique_ptr<IAxis>> m_axes;
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Shard>> m_shards;
+    }; //> end class ShardedHistogram<STORAGE>
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_SHARDEDHISTOGRAM_H
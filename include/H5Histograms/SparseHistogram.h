@@ -0,0 +1,173 @@
+/**
+ * @file SparseHistogram.h
+ * @author Jon Burr
+ * @brief ND histogram that only stores the bins that have been filled
+ * @version 0.0.0
+ * @date 2022-01-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef H5HISTOGRAMS_SPARSEHISTOGRAM_H
+#define H5HISTOGRAMS_SPARSEHISTOGRAM_H
+
+#include "H5Histograms/Histogram.h"
+#include "H5Composites/CompositeDefinition.h"
+
+#include <iterator>
+
+namespace H5Histograms
+{
+    /**
+     * @brief ND histogram that only stores the bins that have been filled
+     *
+     * Intended for high dimensional histograms where only a small fraction of the bins are ever
+     * filled. Each filled bin is stored by its offset (its coordinate) and found through an open
+     * addressing hash table. Unfilled bins read as zero.
+     *
+     * It is written out as the axes and arrays holding the coordinates, counts and sumW2 of each
+     * filled bin. It shares the registered type of Histogram so stored sparse and dense
+     * histograms can be merged together. The result is sparse only if every input was.
+     */
+    template <typename STORAGE>
+    class SparseHistogram : public HistogramBase
+    {
+        friend class H5Composites::CompositeDefinition<SparseHistogram>;
+        friend class Histogram<STORAGE>;
+        static const H5Composites::CompositeDefinition<SparseHistogram> &compositeDefinition();
+
+    public:
+        /// Iterates over the filled bins
+        class const_iterator
+        {
+        public:
+            using difference_type = std::ptrdiff_t;
+            using value_type = std::tuple<STORAGE, STORAGE>;
+            using pointer = const value_type *;
+            using reference = value_type;
+            using iterator_category = std::forward_iterator_tag;
+
+            const_iterator(const SparseHistogram &histogram, std::size_t idx)
+                : m_histo(histogram), m_idx(idx) {}
+
+            /// The contents and sumW2 of the bin pointed to
+            reference operator*() const { return {contents(), sumW2()}; }
+
+            /// The offset of the bin pointed to
+            std::size_t offset() const { return m_histo.m_coordinates[m_idx]; }
+
+            /// Get the current bin indices
+            HistogramBase::index_t indices() const;
+
+            /// Get the contents of the bin pointed to
+            STORAGE contents() const { return m_histo.m_counts[m_idx]; }
+
+            /// Get the sumW2 of the bin pointed to
+            STORAGE sumW2() const { return m_histo.m_sumW2[m_idx]; }
+
+            bool operator==(const const_iterator &other) const
+            {
+                return &m_histo == &other.m_histo && m_idx == other.m_idx;
+            }
+
+            bool operator!=(const const_iterator &other) const { return !(*this == other); }
+
+            const_iterator &operator++()
+            {
+                ++m_idx;
+                return *this;
+            }
+
+            const_iterator operator++(int)
+            {
+                const_iterator itr = *this;
+                ++*this;
+                return itr;
+            }
+
+        private:
+            const SparseHistogram &m_histo;
+            std::size_t m_idx;
+        };
+
+        SparseHistogram(const void *buffer, const H5::DataType &dtype);
+        SparseHistogram(std::vector<std::unique_ptr<IAxis>> &&axes);
+
+        template <typename... AXES>
+        static SparseHistogram create(const AXES &... axes)
+        {
+            std::vector<std::unique_ptr<IAxis>> ptrs;
+            ptrs.reserve(sizeof...(axes));
+            (ptrs.push_back(std::make_unique<AXES>(axes)), ...);
+            return std::move(ptrs);
+        }
+
+        H5::DataType h5DType() const override;
+        void writeBuffer(void *buffer) const override;
+        std::string dtypeKey() const override;
+
+        void fill(const value_t &values, STORAGE weight = 1);
+
+        /// Fill the histogram from one non-owning value per axis, see Histogram::fill
+        void fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight = 1);
+
+        template <std::size_t N>
+        void fill(const std::array<IAxis::value_view_t, N> &values, STORAGE weight = 1)
+        {
+            fill(values.data(), N, weight);
+        }
+
+        /// Fill the histogram from columns of values, see Histogram::fillColumns
+        void fillColumns(
+            const std::vector<IAxis::column_t> &columns,
+            std::size_t nEvents,
+            const STORAGE *weights = nullptr);
+
+        STORAGE contents(const index_t &indices) const;
+
+        STORAGE sumW2(const index_t &indices) const;
+
+        std::size_t nEntries() const { return m_nEntries; }
+
+        /// The number of bins that have been filled
+        std::size_t nFilledBins() const { return m_coordinates.size(); }
+
+        /// Whether any bin's sumW2 differs from its count, i.e. a weight other than 1 was used
+        bool isWeighted() const { return m_counts != m_sumW2; }
+
+        const_iterator begin() const { return const_iterator(*this, 0); }
+
+        const_iterator end() const { return const_iterator(*this, nFilledBins()); }
+
+        /// Add another histogram to this one
+        SparseHistogram &operator+=(const SparseHistogram &h);
+
+        /// Add the non-empty bins of a dense histogram to this one
+        SparseHistogram &operator+=(const Histogram<STORAGE> &h);
+
+        /// Copy the contents into a dense histogram
+        Histogram<STORAGE> toDense() const;
+
+    private:
+        /// The position of a bin in the storage or SIZE_MAX if it has not been filled
+        std::size_t find(std::size_t offset) const;
+
+        /// Add to a bin, creating it if necessary
+        void add(std::size_t offset, STORAGE weight, STORAGE weight2);
+
+        /// Rebuild the hash table from the coordinates
+        void buildIndex();
+
+        void resize(const std::vector<IAxis::ExtensionInfo> &axisExtensions);
+
+        std::size_t m_nEntries;
+        std::vector<std::size_t> m_coordinates;
+        std::vector<STORAGE> m_counts;
+        std::vector<STORAGE> m_sumW2;
+        /// Open addressing hash table from coordinates to storage positions, SIZE_MAX marks an empty slot
+        std::vector<std::size_t> m_index;
+    }; //> end class SparseHistogram<STORAGE>
+} //> end namespace H5Histograms
+
+#endif //> !H5HISTOGRAMS_SPARSEHISTOGRAM_H
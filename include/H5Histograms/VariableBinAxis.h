@@ -34,6 +34,10 @@ namespace H5Histograms
         
         static std::string registeredName() { return "H5Histograms::VariableBinAxis"; }
 
+        std::unique_ptr<IAxis> clone() const override;
+
+        std::string dtypeKey() const override;
+
         /// If the axis is extendable
         bool isExtendable() const override { return false; }
 
@@ -46,6 +50,12 @@ namespace H5Histograms
         /// Get the index of a bin from its value
         IAxis::index_t findBin(const IAxis::value_t &value) const override;
 
+        /// Get the index of the bin containing a value
+        std::size_t findBinIndex(double value) const override;
+
+        /// Get the offsets of the bins for a block of values
+        void binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const override;
+
         /**
          * @brief Extend the axis to contain a particular value
          * 
@@ -58,8 +68,30 @@ namespace H5Histograms
         ExtensionInfo extendAxis(const IAxis::value_t &value, std::size_t &offset) override;
 
         ExtensionInfo compareAxis(const IAxis &other) const;
+
+        /// Variable bin axes are not extendable so this only checks that the axes match
+        ExtensionInfo mergeAxis(const IAxis &other) override;
+
+        /// Throws std::invalid_argument if the range holds none of the non-overflow bins
+        std::unique_ptr<IAxis> slice(std::size_t first, std::size_t last, std::size_t &offset) const override;
     private:
+        /**
+         * @brief Build the bucket table used to accelerate findBinIndex
+         * 
+         * The range of the axis is split into equal width buckets and for each bucket the table
+         * holds the range of edges that can be compared against values falling into it, so a
+         * lookup only has to search a handful of edges. Small axes do not build a table and use
+         * a binary search over all edges
+         */
+        void buildLookup();
+
+        /// The bucket containing a value, only valid for values inside the axis range
+        std::size_t bucket(double value) const;
+
         std::vector<double> m_edges;
+        /// Bucket b holds edges [m_buckets[b], m_buckets[b+1])
+        std::vector<std::size_t> m_buckets;
+        double m_invBucketWidth{0};
     }; //> end class VariableBinAxis
 };     //> end namespace H5Histograms
 
@@ -0,0 +1,415 @@
+#include "H5Histograms/AdaptiveHistogram.h"
+#include "H5Composites/FixedLengthVectorTraits.h"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    /// The number of events for which the batched fill calculates offsets in one go
+    constexpr std::size_t fillBlockSize = 256;
+
+    using array_t = H5Histograms::AdaptiveHistogram::array_t;
+
+    /// The largest integer that a double holds exactly
+    constexpr double maxExactInteger = 9007199254740992.0;
+
+    const H5::PredType &dtypeForIndex(std::size_t idx)
+    {
+        static const std::array<H5::PredType, 5> dtypes{
+            H5::PredType::NATIVE_UINT8,
+            H5::PredType::NATIVE_UINT16,
+            H5::PredType::NATIVE_UINT32,
+            H5::PredType::NATIVE_UINT64,
+            H5::PredType::NATIVE_DOUBLE};
+        return dtypes.at(idx);
+    }
+
+    /// Copy the array into one of a wider type
+    template <typename T>
+    void widenTo(array_t &array)
+    {
+        std::vector<T> wide = std::visit(
+            [](const auto &values) { return std::vector<T>(values.begin(), values.end()); },
+            array);
+        array = std::move(wide);
+    }
+
+    /// Widen the array to the index
+    void widenTo(array_t &array, std::size_t idx)
+    {
+        switch (idx)
+        {
+        case 1:
+            widenTo<std::uint16_t>(array);
+            break;
+        case 2:
+            widenTo<std::uint32_t>(array);
+            break;
+        case 3:
+            widenTo<std::uint64_t>(array);
+            break;
+        default:
+            widenTo<double>(array);
+            break;
+        }
+    }
+
+    /// The index of the narrowest unsigned type that holds a value
+    std::size_t narrowestIndex(std::uint64_t value)
+    {
+        if (value <= std::numeric_limits<std::uint8_t>::max())
+            return 0;
+        else if (value <= std::numeric_limits<std::uint16_t>::max())
+            return 1;
+        else if (value <= std::numeric_limits<std::uint32_t>::max())
+            return 2;
+        else
+            return 3;
+    }
+
+    /// The index of the narrowest type that holds every value in an array
+    std::size_t narrowestIndex(const array_t &array)
+    {
+        if (const std::vector<double> *values = std::get_if<std::vector<double>>(&array))
+        {
+            double max = 0;
+            for (double value : *values)
+            {
+                if (!(value >= 0 && value <= maxExactInteger && value == std::floor(value)))
+                    return 4;
+                max = std::max(max, value);
+            }
+            return narrowestIndex(static_cast<std::uint64_t>(max));
+        }
+        return std::visit(
+            [](const auto &values)
+            {
+                std::uint64_t max = 0;
+                for (auto value : values)
+                    max = std::max<std::uint64_t>(max, value);
+                return narrowestIndex(max);
+            },
+            array);
+    }
+
+    /**
+     * @brief Add a value to one entry of an array, widening the array if it would not fit
+     *
+     * The common case of an integer that fits is handled without touching the rest of the array
+     */
+    void addTo(array_t &array, std::size_t offset, double value)
+    {
+        if (std::vector<double> *values = std::get_if<std::vector<double>>(&array))
+        {
+            (*values)[offset] += value;
+            return;
+        }
+        if (!(value >= 0 && value <= maxExactInteger && value == std::floor(value)))
+        {
+            widenTo<double>(array);
+            std::get<std::vector<double>>(array)[offset] += value;
+            return;
+        }
+        std::uint64_t increment = static_cast<std::uint64_t>(value);
+        bool added = std::visit(
+            [offset, increment](auto &values)
+            {
+                using T = typename std::decay_t<decltype(values)>::value_type;
+                if constexpr (std::is_integral_v<T>)
+                {
+                    if (increment <= std::uint64_t(std::numeric_limits<T>::max()) - values[offset])
+                    {
+                        values[offset] += static_cast<T>(increment);
+                        return true;
+                    }
+                }
+                return false;
+            },
+            array);
+        if (added)
+            return;
+        // Widen far enough for the new total
+        std::uint64_t current = std::visit(
+            [offset](const auto &values) { return static_cast<std::uint64_t>(values[offset]); }, array);
+        if (increment > std::numeric_limits<std::uint64_t>::max() - current)
+            widenTo<double>(array);
+        else
+            widenTo(array, std::max(array.index() + 1, narrowestIndex(current + increment)));
+        addTo(array, offset, value);
+    }
+
+    double valueAt(const array_t &array, std::size_t offset)
+    {
+        return std::visit([offset](const auto &values) { return static_cast<double>(values[offset]); }, array);
+    }
+
+    /// Write every entry of an array as type T
+    template <typename T>
+    void writeAs(const array_t &array, void *buffer)
+    {
+        char *out = static_cast<char *>(buffer);
+        std::visit(
+            [out](const auto &values)
+            {
+                for (std::size_t idx = 0; idx < values.size(); ++idx)
+                {
+                    T value = static_cast<T>(values[idx]);
+                    std::memcpy(out + idx * sizeof(T), &value, sizeof(T));
+                }
+            },
+            array);
+    }
+
+    void writeAs(std::size_t idx, const array_t &array, void *buffer)
+    {
+        switch (idx)
+        {
+        case 0:
+            writeAs<std::uint8_t>(array, buffer);
+            break;
+        case 1:
+            writeAs<std::uint16_t>(array, buffer);
+            break;
+        case 2:
+            writeAs<std::uint32_t>(array, buffer);
+            break;
+        case 3:
+            writeAs<std::uint64_t>(array, buffer);
+            break;
+        default:
+            writeAs<double>(array, buffer);
+            break;
+        }
+    }
+
+    /// Narrow an array as far as its contents allow
+    array_t narrowed(array_t array)
+    {
+        std::size_t narrowest = narrowestIndex(array);
+        if (narrowest < array.index())
+        {
+            array_t narrow = std::visit(
+                [narrowest](const auto &values) -> array_t
+                {
+                    switch (narrowest)
+                    {
+                    case 0:
+                        return std::vector<std::uint8_t>(values.begin(), values.end());
+                    case 1:
+                        return std::vector<std::uint16_t>(values.begin(), values.end());
+                    case 2:
+                        return std::vector<std::uint32_t>(values.begin(), values.end());
+                    default:
+                        return std::vector<std::uint64_t>(values.begin(), values.end());
+                    }
+                },
+                array);
+            array = std::move(narrow);
+        }
+        return array;
+    }
+}
+
+namespace H5Histograms
+{
+    const H5Composites::CompositeDefinition<AdaptiveHistogram> &AdaptiveHistogram::compositeDefinition()
+    {
+        static H5Composites::CompositeDefinition<AdaptiveHistogram> definition;
+        static bool init = false;
+        if (!init)
+        {
+            definition.template add<H5Composites::FLVector<IAxisUPtr>>(&AdaptiveHistogram::m_axes, "axes");
+            definition.template add(&AdaptiveHistogram::m_nEntries, "nEntries");
+            init = true;
+        }
+        return definition;
+    }
+
+    AdaptiveHistogram::AdaptiveHistogram(const void *buffer, const H5::DataType &dtype) : HistogramBase({})
+    {
+        if (isSparse(dtype))
+            throw std::invalid_argument("Data type describes a sparse histogram");
+        compositeDefinition().readBuffer(*this, buffer, dtype);
+        calculateStrides();
+        m_counts = readArray(buffer, dtype, "counts");
+        m_weighted = storesSumW2(dtype);
+        if (m_weighted)
+            m_sumW2 = readArray(buffer, dtype, "sumW2");
+    }
+
+    AdaptiveHistogram::AdaptiveHistogram(std::vector<std::unique_ptr<IAxis>> &&axes)
+        : HistogramBase(std::move(axes)),
+          m_weighted(false),
+          m_nEntries(0),
+          m_counts(std::vector<std::uint8_t>(fullNBins(), 0))
+    {
+    }
+
+    H5::DataType AdaptiveHistogram::h5DType() const
+    {
+        return appendBinArrays(compositeDefinition().dtype(*this), dtypeForIndex(writtenIndex()), m_weighted);
+    }
+
+    void AdaptiveHistogram::writeBuffer(void *buffer) const
+    {
+        writeBufferWithDType(buffer, h5DType());
+    }
+
+    std::string AdaptiveHistogram::dtypeKey() const
+    {
+        return HistogramBase::dtypeKey() + "|" + std::to_string(writtenIndex()) + (m_weighted ? "|w" : "|u");
+    }
+
+    void AdaptiveHistogram::writeBufferWithDType(void *buffer, const H5::DataType &h5DType) const
+    {
+        compositeDefinition().writeBuffer(*this, buffer);
+        H5::CompType dtype(h5DType.getId());
+        std::size_t idx = writtenIndex();
+        writeAs(idx, m_counts, static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("counts")));
+        if (m_weighted)
+            writeAs(idx, m_sumW2, static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("sumW2")));
+    }
+
+    void AdaptiveHistogram::fill(const value_t &values, double weight)
+    {
+        std::size_t offset = binOffsetFromValues(values);
+        if (offset == SIZE_MAX)
+        {
+            std::vector<IAxis::ExtensionInfo> extensions = extendAxes(values, offset);
+            resize(extensions);
+        }
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        add(offset, weight);
+        ++m_nEntries;
+    }
+
+    void AdaptiveHistogram::fill(const IAxis::value_view_t *values, std::size_t nValues, double weight)
+    {
+        std::size_t offset = binOffsetFromValues(values, nValues);
+        if (offset == SIZE_MAX)
+        {
+            std::vector<IAxis::ExtensionInfo> extensions = extendAxes(ownedValues(values, nValues), offset);
+            resize(extensions);
+        }
+        add(offset, weight);
+        ++m_nEntries;
+    }
+
+    void AdaptiveHistogram::fillColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t nEvents,
+        const double *weights)
+    {
+        std::array<std::size_t, fillBlockSize> offsets;
+        std::array<std::size_t, fillBlockSize> scratch;
+        std::size_t first = 0;
+        while (first < nEvents)
+        {
+            std::size_t n = std::min(nEvents - first, fillBlockSize);
+            binOffsetsFromColumns(columns, first, n, offsets.data(), scratch.data());
+            // Only fill up to the first event that has no bin
+            std::size_t nValid = std::find(offsets.begin(), offsets.begin() + n, SIZE_MAX) - offsets.begin();
+            for (std::size_t idx = 0; idx < nValid; ++idx)
+                add(offsets[idx], weights ? weights[first + idx] : 1);
+            m_nEntries += nValid;
+            first += nValid;
+            if (nValid != n)
+            {
+                // Extending an axis changes the offsets of every later event so fill this one on
+                // its own and restart the block after it
+                fill(valuesFromColumns(columns, first), weights ? weights[first] : 1);
+                ++first;
+            }
+        }
+    }
+
+    double AdaptiveHistogram::contents(const index_t &indices) const
+    {
+        std::size_t offset = binOffsetFromIndices(indices);
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        return valueAt(m_counts, offset);
+    }
+
+    double AdaptiveHistogram::sumW2(const index_t &indices) const
+    {
+        std::size_t offset = binOffsetFromIndices(indices);
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        return valueAt(m_weighted ? m_sumW2 : m_counts, offset);
+    }
+
+    H5::PredType AdaptiveHistogram::storageDType() const
+    {
+        return dtypeForIndex(m_counts.index());
+    }
+
+    void AdaptiveHistogram::add(std::size_t offset, double weight)
+    {
+        if (weight != 1 && !m_weighted)
+            makeWeighted();
+        addTo(m_counts, offset, weight);
+        if (m_weighted)
+            addTo(m_sumW2, offset, weight * weight);
+    }
+
+    void AdaptiveHistogram::resize(const std::vector<IAxis::ExtensionInfo> &extensions)
+    {
+        if (extensions.size() != nDims())
+            throw std::invalid_argument("Number of axis extensions does not match the number of dimensions!");
+        // Right now the actual axes are updated but the indexer is not
+        ArrayIndexer oldIndexer = m_indexer;
+        calculateStrides();
+        std::size_t n = fullNBins();
+        auto remap = [&](const auto &oldValues) -> array_t
+        {
+            std::decay_t<decltype(oldValues)> newValues(n, 0);
+            for (std::size_t oldOffset = 0; oldOffset < oldValues.size(); ++oldOffset)
+                newValues.at(mapOffset(oldOffset, oldIndexer, m_indexer, extensions)) += oldValues[oldOffset];
+            return newValues;
+        };
+        m_counts = std::visit(remap, m_counts);
+        if (m_weighted)
+            m_sumW2 = std::visit(remap, m_sumW2);
+    }
+
+    void AdaptiveHistogram::makeWeighted()
+    {
+        if (m_weighted)
+            return;
+        m_sumW2 = m_counts;
+        m_weighted = true;
+    }
+
+    AdaptiveHistogram::array_t AdaptiveHistogram::readArray(
+        const void *buffer, const H5::DataType &dtype, const std::string &name) const
+    {
+        H5::CompType compType(dtype.getId());
+        H5::DataType super = compType.getMemberArrayType(compType.getMemberIndex(name)).getSuper();
+        std::size_t n = fullNBins();
+        if (super.getClass() == H5T_INTEGER && H5::IntType(super.getId()).getSign() == H5T_SGN_NONE)
+        {
+            std::vector<std::uint64_t> values(n);
+            readBinArray(buffer, dtype, name, H5::PredType::NATIVE_UINT64, values.data(), n);
+            return narrowed(std::move(values));
+        }
+        else
+        {
+            std::vector<double> values(n);
+            readBinArray(buffer, dtype, name, H5::PredType::NATIVE_DOUBLE, values.data(), n);
+            return narrowed(std::move(values));
+        }
+    }
+
+    std::size_t AdaptiveHistogram::writtenIndex() const
+    {
+        std::size_t idx = narrowestIndex(m_counts);
+        if (m_weighted)
+            idx = std::max(idx, narrowestIndex(m_sumW2));
+        return idx;
+    }
+} //> end namespace H5Histograms
@@ -158,9 +158,7 @@ namespace H5Histograms
     }
 
     ArrayIndexer::ArrayIndexer(const std::vector<std::size_t> &axisSizes)
-        : m_axisSizes(axisSizes) {}
-
-    std::vector<std::size_t> ArrayIndexer::strides() const { return ::strides(m_axisSizes); }
+        : m_axisSizes(axisSizes), m_strides(::strides(axisSizes)) {}
 
     std::size_t ArrayIndexer::nEntries() const {
         return std::accumulate(m_axisSizes.begin(), m_axisSizes.end(), 1, std::multiplies<std::size_t>{});
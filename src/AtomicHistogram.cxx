@@ -0,0 +1,291 @@
+#include "H5Histograms/AtomicHistogram.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+namespace {
+    /// The number of events for which the batched fill calculates offsets in one go
+    constexpr std::size_t fillBlockSize = 256;
+
+    template <typename T>
+    void atomicAdd(std::atomic<T> &target, T value)
+    {
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            // No fetch_add for floating point types before C++20
+            T current = target.load(std::memory_order_relaxed);
+            while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+            {
+            }
+        }
+        else
+            target.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /// Pick the entry counter for the calling thread
+    std::size_t entryCounterIndex(std::size_t nCounters)
+    {
+        thread_local std::size_t idx = std::hash<std::thread::id>()(std::this_thread::get_id());
+        return idx % nCounters;
+    }
+
+    /// The members written before the bins, the same as those written by Histogram
+    struct Header
+    {
+        std::vector<std::unique_ptr<H5Histograms::IAxis>> axes;
+        std::size_t nEntries;
+    };
+
+    const H5Composites::CompositeDefinition<Header> &headerDefinition()
+    {
+        static H5Composites::CompositeDefinition<Header> definition;
+        static bool init = false;
+        if (!init)
+        {
+            definition.template add<H5Composites::FLVector<H5Histograms::IAxisUPtr>>(&Header::axes, "axes");
+            definition.template add(&Header::nEntries, "nEntries");
+            init = true;
+        }
+        return definition;
+    }
+
+    std::vector<std::unique_ptr<H5Histograms::IAxis>> checkAxes(
+        std::vector<std::unique_ptr<H5Histograms::IAxis>> &&axes)
+    {
+        for (const std::unique_ptr<H5Histograms::IAxis> &axis : axes)
+            if (axis->isExtendable())
+                throw std::invalid_argument(
+                    "Axis '" + axis->label() + "' is extendable which an atomic histogram does not support");
+        return std::move(axes);
+    }
+}
+
+namespace H5Histograms
+{
+    template <typename STORAGE>
+    AtomicHistogram<STORAGE>::AtomicHistogram(std::vector<std::unique_ptr<IAxis>> &&axes)
+        : HistogramBase(checkAxes(std::move(axes))),
+          // Value initialisation zeroes the bins
+          m_bins(new Bin[fullNBins()]())
+    {
+    }
+
+    template <typename STORAGE>
+    AtomicHistogram<STORAGE>::AtomicHistogram(const HistogramBase &prototype)
+        : AtomicHistogram(prototype.cloneAxes())
+    {
+    }
+
+    template <typename STORAGE>
+    H5::DataType AtomicHistogram<STORAGE>::h5DType() const
+    {
+        // Matches a weighted Histogram so that it reads back as one
+        return appendBinArrays(headerDefinition().dtype(Header{cloneAxes(), 0}), nativeDType<STORAGE>(), true);
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::writeBuffer(void *buffer) const
+    {
+        writeBufferWithDType(buffer, h5DType());
+    }
+
+    template <typename STORAGE>
+    std::string AtomicHistogram<STORAGE>::dtypeKey() const
+    {
+        // Always written weighted so there is nothing to add
+        return HistogramBase::dtypeKey();
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::writeBufferWithDType(void *buffer, const H5::DataType &h5DType) const
+    {
+        H5::CompType dtype(h5DType.getId());
+        char *counts = static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("counts"));
+        char *sumW2 = static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("sumW2"));
+        // Take the number of entries in the same pause as the bins so that they agree
+        std::size_t n = 0;
+        whilePaused([&] {
+            n = nEntries();
+            for (std::size_t idx = 0; idx < fullNBins(); ++idx)
+            {
+                STORAGE count = m_bins[idx].count.load(std::memory_order_relaxed);
+                STORAGE w2 = m_bins[idx].sumW2.load(std::memory_order_relaxed);
+                std::memcpy(counts + idx * sizeof(STORAGE), &count, sizeof(STORAGE));
+                std::memcpy(sumW2 + idx * sizeof(STORAGE), &w2, sizeof(STORAGE));
+            }
+        });
+        headerDefinition().writeBuffer(Header{cloneAxes(), n}, buffer);
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::fill(const value_t &values, STORAGE weight)
+    {
+        std::size_t offset = binOffsetFromValues(values);
+        if (offset == SIZE_MAX)
+            throw std::out_of_range("No bin exists for the provided values");
+        std::size_t counter = beginFill();
+        add(offset, weight);
+        addEntries(1);
+        endFill(counter);
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight)
+    {
+        std::size_t offset = binOffsetFromValues(values, nValues);
+        if (offset == SIZE_MAX)
+            throw std::out_of_range("No bin exists for the provided values");
+        std::size_t counter = beginFill();
+        add(offset, weight);
+        addEntries(1);
+        endFill(counter);
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::fillColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t nEvents,
+        const STORAGE *weights)
+    {
+        std::array<std::size_t, fillBlockSize> offsets;
+        std::array<std::size_t, fillBlockSize> scratch;
+        for (std::size_t first = 0; first < nEvents; first += fillBlockSize)
+        {
+            std::size_t n = std::min(nEvents - first, fillBlockSize);
+            binOffsetsFromColumns(columns, first, n, offsets.data(), scratch.data());
+            // Only fill up to the first event that has no bin
+            std::size_t nValid = std::find(offsets.begin(), offsets.begin() + n, SIZE_MAX) - offsets.begin();
+            // Register once per block so that the cost is shared between its events
+            std::size_t counter = beginFill();
+            for (std::size_t idx = 0; idx < nValid; ++idx)
+                add(offsets[idx], weights ? weights[first + idx] : 1);
+            addEntries(nValid);
+            endFill(counter);
+            if (nValid != n)
+                throw std::out_of_range("No bin exists for event " + std::to_string(first + nValid));
+        }
+    }
+
+    template <typename STORAGE>
+    STORAGE AtomicHistogram<STORAGE>::contents(const index_t &indices) const
+    {
+        std::size_t offset = binOffsetFromIndices(indices);
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        return m_bins[offset].count.load(std::memory_order_relaxed);
+    }
+
+    template <typename STORAGE>
+    STORAGE AtomicHistogram<STORAGE>::sumW2(const index_t &indices) const
+    {
+        std::size_t offset = binOffsetFromIndices(indices);
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        return m_bins[offset].sumW2.load(std::memory_order_relaxed);
+    }
+
+    template <typename STORAGE>
+    std::size_t AtomicHistogram<STORAGE>::nEntries() const
+    {
+        std::size_t n = 0;
+        for (const StripedCounter &counter : m_nEntries)
+            n += counter.value.load(std::memory_order_relaxed);
+        return n;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> AtomicHistogram<STORAGE>::snapshot() const
+    {
+        std::size_t n = fullNBins();
+        std::vector<STORAGE> counts(n);
+        std::vector<STORAGE> sumW2(n);
+        std::size_t entries = 0;
+        whilePaused([&] {
+            entries = nEntries();
+            for (std::size_t idx = 0; idx < n; ++idx)
+            {
+                counts[idx] = m_bins[idx].count.load(std::memory_order_relaxed);
+                sumW2[idx] = m_bins[idx].sumW2.load(std::memory_order_relaxed);
+            }
+        });
+        return Histogram<STORAGE>(cloneAxes(), counts, sumW2, entries);
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::add(std::size_t offset, STORAGE weight)
+    {
+        atomicAdd(m_bins[offset].count, weight);
+        atomicAdd(m_bins[offset].sumW2, static_cast<STORAGE>(weight * weight));
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::addEntries(std::size_t n)
+    {
+        m_nEntries[entryCounterIndex(nEntryCounters)].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    template <typename STORAGE>
+    std::size_t AtomicHistogram<STORAGE>::beginFill()
+    {
+        std::size_t counter = entryCounterIndex(nEntryCounters);
+        while (true)
+        {
+            // Both this and the check of the flag must be sequentially consistent, pairing with
+            // whilePaused, so that either the fill sees the pause or the read sees the fill
+            m_fillsInProgress[counter].value.fetch_add(1, std::memory_order_seq_cst);
+            if (!m_paused.load(std::memory_order_seq_cst))
+                return counter;
+            // Step back out of the way until the read has finished
+            m_fillsInProgress[counter].value.fetch_sub(1, std::memory_order_release);
+            while (m_paused.load(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+    }
+
+    template <typename STORAGE>
+    void AtomicHistogram<STORAGE>::endFill(std::size_t counter)
+    {
+        // Release the bin updates to the read that waits for this counter to reach zero
+        m_fillsInProgress[counter].value.fetch_sub(1, std::memory_order_release);
+    }
+
+    template <typename STORAGE>
+    template <typename F>
+    void AtomicHistogram<STORAGE>::whilePaused(F &&read) const
+    {
+        std::lock_guard<std::mutex> lock(m_pauseMutex);
+        m_paused.store(true, std::memory_order_seq_cst);
+        for (const StripedCounter &counter : m_fillsInProgress)
+            while (counter.value.load(std::memory_order_seq_cst) != 0)
+                std::this_thread::yield();
+        try
+        {
+            read();
+        }
+        catch (...)
+        {
+            m_paused.store(false, std::memory_order_release);
+            throw;
+        }
+        m_paused.store(false, std::memory_order_release);
+    }
+
+    // Force the instantiation of the types defined in Histogram.h
+    template class AtomicHistogram<int>;
+    template class AtomicHistogram<unsigned int>;
+    template class AtomicHistogram<char>;
+    template class AtomicHistogram<signed char>;
+    template class AtomicHistogram<unsigned char>;
+    template class AtomicHistogram<short>;
+    template class AtomicHistogram<unsigned short>;
+    template class AtomicHistogram<long>;
+    template class AtomicHistogram<long long>;
+    template class AtomicHistogram<unsigned long>;
+    template class AtomicHistogram<unsigned long long>;
+    template class AtomicHistogram<float>;
+    template class AtomicHistogram<double>;
+} //> end namespace H5Histograms
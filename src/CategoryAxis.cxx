@@ -5,6 +5,17 @@
 #include "H5Composites/CompDTypeUtils.h"
 
 #include <algorithm>
+#include <functional>
+
+namespace {
+    /// The index is rebuilt to keep at most this fraction of the slots filled
+    constexpr std::size_t indexLoadDenominator = 2;
+
+    std::size_t hashCategory(std::string_view category)
+    {
+        return std::hash<std::string_view>{}(category);
+    }
+}
 
 H5HISTOGRAMS_REGISTER_IAXIS(H5Histograms::CategoryAxis)
 
@@ -28,6 +39,7 @@ namespace H5Histograms
     CategoryAxis::CategoryAxis(const void *buffer, const H5::DataType &dtype)
     {
         compositeDefinition().readBuffer(*this, buffer, dtype);
+        buildIndex();
     }
 
     CategoryAxis::CategoryAxis(
@@ -38,6 +50,7 @@ namespace H5Histograms
           m_categories(categories),
           m_extendable(extendable)
     {
+        buildIndex();
     }
 
     void CategoryAxis::writeBuffer(void *buffer) const
@@ -61,6 +74,18 @@ namespace H5Histograms
 
     void CategoryAxis::merge(const CategoryAxis &other)
     {
+        mergeAxis(other);
+    }
+
+    std::unique_ptr<IAxis> CategoryAxis::clone() const
+    {
+        return std::make_unique<CategoryAxis>(*this);
+    }
+
+    IAxis::ExtensionInfo CategoryAxis::mergeAxis(const IAxis &_other)
+    {
+        const CategoryAxis &other = dynamic_cast<const CategoryAxis &>(_other);
+        std::size_t oldNBins = fullNBins();
         if (m_label != other.m_label)
             throw std::invalid_argument("Axis labels do not match '" + m_label + "' != '" + other.m_label + "'");
         if (m_extendable != other.m_extendable)
@@ -69,11 +94,20 @@ namespace H5Histograms
         {
             // Need to add any categories that are not already present
             for (const std::string &category : other.m_categories)
-                if (std::find(m_categories.begin(), m_categories.end(), category) == m_categories.end())
-                    m_categories.push_back(category);
+                if (findCategory(category) == SIZE_MAX)
+                    addCategory(category);
         }
         else if (m_categories != other.m_categories)
             throw std::invalid_argument("Categories do not match!");
+        return ExtensionInfo::createIdentity(oldNBins);
+    }
+
+    std::string CategoryAxis::dtypeKey() const
+    {
+        std::string key = "H5Histograms::CategoryAxis;" + std::to_string(m_label.size());
+        for (const std::string &category : m_categories)
+            key += ";" + std::to_string(category.size());
+        return key;
     }
 
     std::size_t CategoryAxis::fullNBins() const
@@ -86,16 +120,49 @@ namespace H5Histograms
 
     std::size_t CategoryAxis::binOffsetFromValue(const IAxis::value_t &value) const
     {
-        auto itr = std::find(m_categories.begin(), m_categories.end(), std::get<0>(value));
-        if (itr == m_categories.end())
+        return binOffsetFromCategory(std::get<0>(value));
+    }
+
+    std::size_t CategoryAxis::binOffsetFromCategory(std::string_view value) const
+    {
+        std::size_t offset = findCategory(value);
+        if (offset == SIZE_MAX && !m_extendable)
+            // Goes into the overflow bin
+            return m_categories.size();
+        else
+            return offset;
+    }
+
+    void CategoryAxis::binOffsetsFromCategory(const std::string *values, std::size_t n, std::size_t *offsets) const
+    {
+        for (std::size_t idx = 0; idx < n; ++idx)
+            offsets[idx] = CategoryAxis::binOffsetFromCategory(values[idx]);
+    }
+
+    IAxis::CategoryToken CategoryAxis::token(std::string_view category) const
+    {
+        std::size_t offset = binOffsetFromCategory(category);
+        if (offset == SIZE_MAX)
+            throw std::out_of_range("Category '" + std::string(category) + "' is not on axis '" + m_label + "'");
+        return CategoryToken{offset};
+    }
+
+    std::size_t CategoryAxis::binOffsetFromToken(CategoryToken token) const
+    {
+        if (token.offset >= fullNBins())
+            throw std::out_of_range("Invalid token for axis '" + m_label + "'");
+        return token.offset;
+    }
+
+    void CategoryAxis::binOffsetsFromTokens(const CategoryToken *tokens, std::size_t n, std::size_t *offsets) const
+    {
+        std::size_t nFull = fullNBins();
+        for (std::size_t idx = 0; idx < n; ++idx)
         {
-            if (m_extendable)
-                return SIZE_MAX;
-            else
-                return m_categories.size();
+            if (tokens[idx].offset >= nFull)
+                throw std::out_of_range("Invalid token for axis '" + m_label + "'");
+            offsets[idx] = tokens[idx].offset;
         }
-        else
-            return std::distance(m_categories.begin(), itr);
     }
 
     std::size_t CategoryAxis::binOffsetFromIndex(const IAxis::index_t &index) const
@@ -121,21 +188,21 @@ namespace H5Histograms
 
     bool CategoryAxis::containsValue(const IAxis::value_t &value) const
     {
-        return std::find(m_categories.begin(), m_categories.end(), std::get<0>(value)) != m_categories.end();
+        return findCategory(std::get<0>(value)) != SIZE_MAX;
     }
 
     IAxis::ExtensionInfo CategoryAxis::extendAxis(
         const IAxis::value_t &variantValue, std::size_t &offset)
     {
         std::size_t oldNBins = nBins();
-        std::string value = std::get<0>(variantValue);
-        offset = binOffsetFromValue(value);
+        const std::string &value = std::get<0>(variantValue);
+        offset = binOffsetFromCategory(value);
         if (offset == SIZE_MAX)
         {
             // No appropriate bin exists
             // set the offset to be the new bin
             offset = m_categories.size();
-            m_categories.push_back(value);
+            addCategory(value);
         }
         // No matter what existing bins get remapped to the same index (the new bin is at the end)
         return ExtensionInfo::createIdentity(oldNBins);
@@ -154,11 +221,66 @@ namespace H5Histograms
         map.reserve(other.fullNBins());
         for (const std::string &category : other.m_categories)
         {
-            auto itr = std::find(m_categories.begin(), m_categories.end(), category);
-            if (itr == m_categories.end())
+            std::size_t offset = findCategory(category);
+            if (offset == SIZE_MAX)
                 throw std::out_of_range("Missing category: " + category);
-            map.push_back(std::distance(m_categories.begin(), itr));
+            map.push_back(offset);
         }
         return ExtensionInfo::createMapped(map);
     }
+
+    std::unique_ptr<IAxis> CategoryAxis::slice(std::size_t first, std::size_t last, std::size_t &offset) const
+    {
+        if (first >= last || last > fullNBins())
+            throw std::out_of_range("Invalid bin range for axis '" + m_label + "'");
+        // The overflow bin, if there is one, comes after the categories
+        offset = 0;
+        return std::make_unique<CategoryAxis>(
+            m_label,
+            std::vector<std::string>(
+                m_categories.begin() + first, m_categories.begin() + std::min(last, m_categories.size())),
+            m_extendable);
+    }
+
+    std::size_t CategoryAxis::findCategory(std::string_view category) const
+    {
+        if (m_index.empty())
+            return SIZE_MAX;
+        std::size_t mask = m_index.size() - 1;
+        for (std::size_t slot = hashCategory(category) & mask; m_index[slot] != SIZE_MAX; slot = (slot + 1) & mask)
+            if (m_categories[m_index[slot]] == category)
+                return m_index[slot];
+        return SIZE_MAX;
+    }
+
+    void CategoryAxis::addCategory(const std::string &category)
+    {
+        m_categories.push_back(category);
+        if (indexLoadDenominator * m_categories.size() > m_index.size())
+            buildIndex();
+        else
+            indexCategory(m_categories.size() - 1);
+    }
+
+    void CategoryAxis::indexCategory(std::size_t offset)
+    {
+        std::size_t mask = m_index.size() - 1;
+        std::size_t slot = hashCategory(m_categories[offset]) & mask;
+        for (; m_index[slot] != SIZE_MAX; slot = (slot + 1) & mask)
+            if (m_categories[m_index[slot]] == m_categories[offset])
+                // Duplicated categories resolve to the first one
+                return;
+        m_index[slot] = offset;
+    }
+
+    void CategoryAxis::buildIndex()
+    {
+        // Keep the size a power of two so that the slot can be taken with a mask
+        std::size_t size = 8;
+        while (size < indexLoadDenominator * m_categories.size())
+            size *= 2;
+        m_index.assign(size, SIZE_MAX);
+        for (std::size_t offset = 0; offset < m_categories.size(); ++offset)
+            indexCategory(offset);
+    }
 }
@@ -0,0 +1,171 @@
+#include "H5Histograms/Checkpointer.h"
+
+#include <stdexcept>
+
+namespace H5Histograms
+{
+    template <typename STORAGE>
+    Checkpointer<STORAGE>::Checkpointer(
+        const H5::Group &location, const std::string &name, const ChunkedLayout &layout)
+        // Reopen the location so that files are held as their root group rather than sliced
+        : m_location(location.openGroup(".")), m_name(name), m_layout(layout)
+    {
+        hbool_t threadSafe = false;
+        H5is_library_threadsafe(&threadSafe);
+        // Otherwise the background thread could call HDF5 at the same time as the caller
+        if (threadSafe)
+            m_thread = std::thread([this] () { run(); });
+    }
+
+    template <typename STORAGE>
+    Checkpointer<STORAGE>::~Checkpointer()
+    {
+        if (!isAsynchronous())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    template <typename STORAGE>
+    void Checkpointer<STORAGE>::checkpoint(Histogram<STORAGE> &histogram, callback_t callback)
+    {
+        if (!isAsynchronous())
+        {
+            writeNow(histogram, callback);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (onWriterThread())
+        {
+            // Called back once a write is over, nothing else can have been submitted since
+            if (m_submitted)
+                throw std::logic_error("A callback can only submit one checkpoint");
+        }
+        else
+            m_cv.wait(lock, [this] () { return !m_inFlight; });
+        submit(histogram, std::move(callback));
+        lock.unlock();
+        m_cv.notify_all();
+    }
+
+    template <typename STORAGE>
+    bool Checkpointer<STORAGE>::tryCheckpoint(Histogram<STORAGE> &histogram, callback_t callback)
+    {
+        if (!isAsynchronous())
+        {
+            writeNow(histogram, callback);
+            return true;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (onWriterThread() ? m_submitted : m_inFlight)
+            return false;
+        submit(histogram, std::move(callback));
+        lock.unlock();
+        m_cv.notify_all();
+        return true;
+    }
+
+    template <typename STORAGE>
+    bool Checkpointer<STORAGE>::busy() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return onWriterThread() ? m_submitted : m_inFlight;
+    }
+
+    template <typename STORAGE>
+    void Checkpointer<STORAGE>::wait()
+    {
+        // From a callback the only write left to wait for would be one it submitted itself
+        if (onWriterThread())
+            return;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] () { return !m_inFlight; });
+    }
+
+    template <typename STORAGE>
+    void Checkpointer<STORAGE>::submit(Histogram<STORAGE> &histogram, callback_t callback)
+    {
+        if (!m_snapshot)
+            m_snapshot.emplace(histogram.cloneAxes());
+        // The copy takes the recorded changes with it, so the next checkpoint only has the later ones
+        histogram.copyInto(*m_snapshot);
+        histogram.clearChanges();
+        m_callback = std::move(callback);
+        m_submitted = true;
+        m_inFlight = true;
+    }
+
+    template <typename STORAGE>
+    void Checkpointer<STORAGE>::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            // Finish any write that was submitted before stopping
+            m_cv.wait(lock, [this] () { return m_submitted || m_stop; });
+            if (!m_submitted)
+                return;
+            m_submitted = false;
+            callback_t callback = std::move(m_callback);
+            lock.unlock();
+            std::exception_ptr error = write(*m_snapshot);
+            // The write only counts as finished once the callback returns, so that nothing but
+            // the callback can submit the next checkpoint while it runs
+            if (callback)
+                callback(error);
+            lock.lock();
+            if (!m_submitted)
+            {
+                m_inFlight = false;
+                m_cv.notify_all();
+            }
+        }
+    }
+
+    template <typename STORAGE>
+    void Checkpointer<STORAGE>::writeNow(Histogram<STORAGE> &histogram, const callback_t &callback)
+    {
+        std::exception_ptr error = write(histogram);
+        if (callback)
+            callback(error);
+    }
+
+    template <typename STORAGE>
+    std::exception_ptr Checkpointer<STORAGE>::write(Histogram<STORAGE> &histogram)
+    {
+        try
+        {
+            if (m_rewrite)
+                // Whatever the failed write left behind is replaced by a fresh base
+                histogram.m_axesChanged = true;
+            histogram.writeCheckpoint(m_location, m_name, m_layout);
+            m_location.flush(H5F_SCOPE_LOCAL);
+            m_rewrite = false;
+            return nullptr;
+        }
+        catch (...)
+        {
+            m_rewrite = true;
+            return std::current_exception();
+        }
+    }
+
+    // Force the instantiation of the types we defined before
+    template class Checkpointer<int>;
+    template class Checkpointer<unsigned int>;
+    template class Checkpointer<char>;
+    template class Checkpointer<signed char>;
+    template class Checkpointer<unsigned char>;
+    template class Checkpointer<short>;
+    template class Checkpointer<unsigned short>;
+    template class Checkpointer<long>;
+    template class Checkpointer<long long>;
+    template class Checkpointer<unsigned long>;
+    template class Checkpointer<unsigned long long>;
+    template class Checkpointer<float>;
+    template class Checkpointer<double>;
+} //> end namespace H5Histograms
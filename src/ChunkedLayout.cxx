@@ -0,0 +1,53 @@
+#include "H5Histograms/ChunkedLayout.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+    hsize_t product(const std::vector<hsize_t> &dims)
+    {
+        return std::accumulate(dims.begin(), dims.end(), hsize_t(1), std::multiplies<hsize_t>());
+    }
+}
+
+namespace H5Histograms
+{
+    const std::string ChunkedLayout::headerName = "header";
+    const std::string ChunkedLayout::countsName = "counts";
+    const std::string ChunkedLayout::sumW2Name = "sumW2";
+    const std::string ChunkedLayout::deltaRunsName = "deltaRuns";
+    const std::string ChunkedLayout::deltaValuesName = "deltaValues";
+    const std::string ChunkedLayout::deltaEntriesName = "deltaEntries";
+    const std::string ChunkedLayout::partialSuffix = ".partial";
+
+    H5::DSetCreatPropList ChunkedLayout::createPropList(const std::vector<hsize_t> &dims, std::size_t elementSize) const
+    {
+        std::vector<hsize_t> chunk = chunkDims;
+        if (chunk.empty())
+        {
+            // Chunks cannot have zero size even if the dataset does
+            chunk.reserve(dims.size());
+            for (hsize_t dim : dims)
+                chunk.push_back(std::max<hsize_t>(dim, 1));
+            // Halve the outermost axes first so that each chunk holds whole rows if possible
+            std::size_t idx = 0;
+            while (idx < chunk.size() && product(chunk) * elementSize > defaultChunkBytes)
+            {
+                if (chunk[idx] > 1)
+                    chunk[idx] = (chunk[idx] + 1) / 2;
+                else
+                    ++idx;
+            }
+        }
+        else if (chunk.size() != dims.size())
+            throw std::invalid_argument("Chunk dimensions do not match the number of axes");
+        H5::DSetCreatPropList propList;
+        propList.setChunk(chunk.size(), chunk.data());
+        if (shuffle)
+            propList.setShuffle();
+        if (deflateLevel > 0)
+            propList.setDeflate(deflateLevel);
+        return propList;
+    }
+} //> end namespace H5Histograms
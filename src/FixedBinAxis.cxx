@@ -4,6 +4,15 @@
 
 #include <stdexcept>
 #include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// The vectorised kernels are built for their own instruction sets and picked at run time, so they
+// do not need the whole library to be compiled for the host CPU
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define H5HISTOGRAMS_X86_KERNELS
+#include <immintrin.h>
+#endif
 
 H5COMPOSITES_DEFINE_ENUM_DTYPE(H5Histograms::FixedBinAxis::ExtensionType, NoExtension, PreserveNBins, PreserveBinWidth)
 
@@ -11,21 +20,160 @@ H5HISTOGRAMS_REGISTER_IAXIS(H5Histograms::FixedBinAxis)
 
 namespace {
 
+    /// Relative tolerance when comparing bin edges, which pick up rounding errors as axes are extended
+    constexpr double edgeTolerance = 1e-9;
+
     long nBins(double binDiff, double binWidth)
     {
-        double integral;
-        double fractional = std::modf(binDiff/binWidth, &integral);
-        if (fractional != 0)
+        double n = binDiff / binWidth;
+        double integral = std::round(n);
+        if (std::abs(n - integral) > edgeTolerance * std::max(1.0, std::abs(n)))
             throw std::invalid_argument("Bin edges not compatible");
         return static_cast<long>(integral);
     }
 
     std::pair<long, long> nBelowAbove(const H5Histograms::FixedBinAxis &lhs, const H5Histograms::FixedBinAxis &rhs)
     {
-        if (lhs.binWidth() != rhs.binWidth())
+        if (std::abs(lhs.binWidth() - rhs.binWidth()) > edgeTolerance * lhs.binWidth())
             throw std::invalid_argument("Bin widths do not match!");
         return std::make_pair(nBins(lhs.min() - rhs.min(), lhs.binWidth()), nBins(lhs.max() - rhs.max(), rhs.binWidth()));
     }
+
+    /**
+     * @brief Map a value onto a bin index in the range [-1, nBins]
+     * 
+     * -1 and nBins correspond to the under and overflow. The comparisons are written so that NaN
+     * ends up in the underflow, matching the vectorised versions below
+     */
+    inline double clampedIndex(double value, double min, double invBinWidth, double nBins)
+    {
+        double idx = std::floor((value - min) * invBinWidth);
+        idx = idx > -1 ? idx : -1;
+        return idx < nBins ? idx : nBins;
+    }
+
+#ifdef H5HISTOGRAMS_X86_KERNELS
+    /// AVX-512 version of binOffsets, returning the number of values that it handled
+    __attribute__((target("avx512f,avx512dq")))
+    std::size_t binOffsetsAVX512(
+        const double *values, std::size_t n, double min, double invBinWidth, std::size_t nBins,
+        bool flow, std::size_t *offsets)
+    {
+        std::size_t idx = 0;
+        const __m512d vMin = _mm512_set1_pd(min);
+        const __m512d vInvBinWidth = _mm512_set1_pd(invBinWidth);
+        const __m512d vLow = _mm512_set1_pd(-1);
+        const __m512d vHigh = _mm512_set1_pd(nBins);
+        const __m512i vOne = _mm512_set1_epi64(1);
+        const __m512i vZero = _mm512_setzero_si512();
+        const __m512i vNBins = _mm512_set1_epi64(nBins);
+        const __m512i vInvalid = _mm512_set1_epi64(-1);
+        for (; idx + 8 <= n; idx += 8)
+        {
+            __m512d binIdx = _mm512_roundscale_pd(
+                _mm512_mul_pd(_mm512_sub_pd(_mm512_loadu_pd(values + idx), vMin), vInvBinWidth),
+                _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+            // max/min return their second operand for NaN so these match clampedIndex
+            binIdx = _mm512_min_pd(_mm512_max_pd(binIdx, vLow), vHigh);
+            __m512i offset = _mm512_cvttpd_epi64(binIdx);
+            if (flow)
+                offset = _mm512_add_epi64(offset, vOne);
+            else
+            {
+                __mmask8 outside = _mm512_cmplt_epi64_mask(offset, vZero) | _mm512_cmpge_epi64_mask(offset, vNBins);
+                offset = _mm512_mask_mov_epi64(offset, outside, vInvalid);
+            }
+            _mm512_storeu_si512(offsets + idx, offset);
+        }
+        return idx;
+    }
+
+    /// AVX2 version of binOffsets, returning the number of values that it handled
+    __attribute__((target("avx2")))
+    std::size_t binOffsetsAVX2(
+        const double *values, std::size_t n, double min, double invBinWidth, std::size_t nBins,
+        bool flow, std::size_t *offsets)
+    {
+        std::size_t idx = 0;
+        // The conversion goes through 32 bit integers
+        if (nBins >= INT32_MAX)
+            return idx;
+        const __m256d vMin = _mm256_set1_pd(min);
+        const __m256d vInvBinWidth = _mm256_set1_pd(invBinWidth);
+        const __m256d vLow = _mm256_set1_pd(-1);
+        const __m256d vHigh = _mm256_set1_pd(nBins);
+        const __m256i vOne = _mm256_set1_epi64x(1);
+        const __m256i vZero = _mm256_setzero_si256();
+        const __m256i vLast = _mm256_set1_epi64x(nBins - 1);
+        for (; idx + 4 <= n; idx += 4)
+        {
+            __m256d binIdx = _mm256_floor_pd(
+                _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(values + idx), vMin), vInvBinWidth));
+            // max/min return their second operand for NaN so these match clampedIndex
+            binIdx = _mm256_min_pd(_mm256_max_pd(binIdx, vLow), vHigh);
+            __m256i offset = _mm256_cvtepi32_epi64(_mm256_cvttpd_epi32(binIdx));
+            if (flow)
+                offset = _mm256_add_epi64(offset, vOne);
+            else
+                // Setting every bit of an out of range offset makes it SIZE_MAX
+                offset = _mm256_or_si256(
+                    offset,
+                    _mm256_or_si256(
+                        _mm256_cmpgt_epi64(vZero, offset), _mm256_cmpgt_epi64(offset, vLast)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(offsets + idx), offset);
+        }
+        return idx;
+    }
+
+    using binOffsetsKernel_t = std::size_t (*)(
+        const double *, std::size_t, double, double, std::size_t, bool, std::size_t *);
+
+    /// Pick the widest kernel that the CPU supports, or nullptr to only use the scalar loop
+    binOffsetsKernel_t selectBinOffsetsKernel()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+            return binOffsetsAVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return binOffsetsAVX2;
+        return nullptr;
+    }
+#endif
+
+    /**
+     * @brief Calculate the bin offsets for a block of values
+     * 
+     * @param values The values
+     * @param n The number of values
+     * @param min The lower edge of the axis
+     * @param invBinWidth The inverse of the bin width
+     * @param nBins The number of bins on the axis
+     * @param flow Whether the axis has under and overflow bins. If not, values outside of the axis
+     * range get SIZE_MAX
+     * @param[out] offsets The bin offsets
+     */
+    void binOffsets(
+        const double *values, std::size_t n, double min, double invBinWidth, std::size_t nBins,
+        bool flow, std::size_t *offsets)
+    {
+        std::size_t idx = 0;
+        const double dNBins = nBins;
+#ifdef H5HISTOGRAMS_X86_KERNELS
+        static const binOffsetsKernel_t kernel = selectBinOffsetsKernel();
+        if (kernel)
+            idx = kernel(values, n, min, invBinWidth, nBins, flow, offsets);
+#endif
+        // The scalar loop handles whatever the kernel left over
+        if (flow)
+            for (; idx < n; ++idx)
+                offsets[idx] = static_cast<std::size_t>(clampedIndex(values[idx], min, invBinWidth, dNBins) + 1);
+        else
+            for (; idx < n; ++idx)
+            {
+                double binIdx = clampedIndex(values[idx], min, invBinWidth, dNBins);
+                offsets[idx] = (binIdx < 0 || binIdx == dNBins) ? SIZE_MAX : static_cast<std::size_t>(binIdx);
+            }
+    }
 }
 
 namespace H5Histograms
@@ -58,12 +206,14 @@ namespace H5Histograms
           m_max(max),
           m_extension(extension)
     {
+        updateInvBinWidth();
     }
 
     FixedBinAxis::FixedBinAxis(const void *buffer, const H5::DataType &dtype)
         : NumericAxis("")
     {
         compositeDefinition().readBuffer(*this, buffer, dtype);
+        updateInvBinWidth();
     }
 
     H5::DataType FixedBinAxis::h5DType() const
@@ -87,37 +237,17 @@ namespace H5Histograms
 
     void FixedBinAxis::merge(const FixedBinAxis &other)
     {
-        if (m_label != other.m_label)
-            throw std::invalid_argument("Axis labels do not match '" + m_label + "' != '" + other.m_label + "'");
-        if (m_extension != other.m_extension)
-            throw std::invalid_argument("Extension does not match!");
-        if (m_nBins == other.m_nBins && m_min == other.m_min && m_max == other.m_max)
-            return;
-        switch(m_extension)
-        {
-        case ExtensionType::NoExtension:
-            throw std::invalid_argument("Parameters do not match on non-extendable axis");
-        case ExtensionType::PreserveNBins:
-            throw std::logic_error("Not implemented!");
-        case ExtensionType::PreserveBinWidth:
-        {
-            std::pair<long, long> nBelowAbove = ::nBelowAbove(*this, other);
-            if (nBelowAbove.first > 0)
-            {
-                // our min is more than theirs
-                m_min -= nBelowAbove.first * binWidth();
-                m_nBins += nBelowAbove.first;
-            }
-            if (nBelowAbove.second < 0)
-            {
-                // our max is less than theirs
-                m_max += std::abs(nBelowAbove.second) * binWidth();
-                m_nBins += std::abs(nBelowAbove.second);
-            }
-        }
-        default:
-            throw std::logic_error("Invalid enum value");
-        }
+        mergeAxis(other);
+    }
+
+    std::unique_ptr<IAxis> FixedBinAxis::clone() const
+    {
+        return std::make_unique<FixedBinAxis>(*this);
+    }
+
+    std::string FixedBinAxis::dtypeKey() const
+    {
+        return registeredName() + ";" + std::to_string(m_label.size());
     }
 
     std::size_t FixedBinAxis::fullNBins() const
@@ -128,46 +258,34 @@ namespace H5Histograms
             return nBins() + 2;
     }
 
-    IAxis::index_t FixedBinAxis::findBin(const IAxis::value_t &variantValue) const
+    IAxis::index_t FixedBinAxis::findBin(const IAxis::value_t &value) const
     {
-        double value = std::get<1>(variantValue);
-        // first figure out if this falls inside the range
-        int idx = (value - m_min) / binWidth();
-        if (idx < 0)
-        {
-            // Falls below the range
-            if (isExtendable())
-                // There is no bin for this yet so return SIZE_MAX
-                return SIZE_MAX;
-            else
-                // Goes into the underflow bin
-                return static_cast<std::size_t>(0);
-        }
-        else if (idx > m_nBins)
-        {
-            // Falls above the range
-            if (isExtendable())
-                // There is no bin for this yet so return SIZE_MAX
-                return SIZE_MAX;
-            else
-                // Goes into the overflow bin
-                return m_nBins + 1;
-        }
-        else
-        {
-            if (isExtendable())
-                // No overflow/underflow bin so it's a direct conversion
-                return static_cast<std::size_t>(idx);
-            else
-                // Index '0' is reserved for underflow so bump up all numbers by 1
-                return static_cast<std::size_t>(idx + 1);
-        }
+        return findBinIndex(std::get<1>(value));
+    }
+
+    std::size_t FixedBinAxis::findBinIndex(double value) const
+    {
+        std::size_t offset;
+        ::binOffsets(&value, 1, m_min, m_invBinWidth, m_nBins, !isExtendable(), &offset);
+        return offset;
     }
 
-    IAxis::ExtensionInfo FixedBinAxis::extendAxis(const IAxis::value_t &value, std::size_t &offset)
+    std::size_t FixedBinAxis::binOffsetFromNumeric(double value) const
     {
+        // findBinIndex only returns valid offsets or SIZE_MAX
+        return findBinIndex(value);
+    }
+
+    void FixedBinAxis::binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const
+    {
+        ::binOffsets(values, n, m_min, m_invBinWidth, m_nBins, !isExtendable(), offsets);
+    }
+
+    IAxis::ExtensionInfo FixedBinAxis::extendAxis(const IAxis::value_t &variantValue, std::size_t &offset)
+    {
+        double value = std::get<1>(variantValue);
         // first figure out if this falls inside the range
-        std::size_t bin = std::get<1>(findBin(value));
+        std::size_t bin = findBinIndex(value);
         std::size_t oldNBins = nBins();
         if (bin != SIZE_MAX)
         {
@@ -175,7 +293,10 @@ namespace H5Histograms
             offset = bin;
             return ExtensionInfo::createIdentity(oldNBins);
         }
-        int idx = (std::get<1>(value) - m_min) / binWidth();
+        if (!std::isfinite(value))
+            throw std::invalid_argument("Cannot extend axis '" + m_label + "' to a non-finite value");
+        double width = binWidth();
+        double idx = std::floor((value - m_min) * m_invBinWidth);
         switch (m_extension)
         {
         case ExtensionType::PreserveNBins:
@@ -183,19 +304,23 @@ namespace H5Histograms
         case ExtensionType::PreserveBinWidth:
             if (idx < 0)
             {
+                std::size_t nBelow = -idx;
                 // Change the internal parameters
-                m_min -= binWidth() * std::abs(idx);
-                m_nBins += std::abs(idx);
+                m_min -= width * nBelow;
+                m_nBins += nBelow;
+                updateInvBinWidth();
                 // New value is in the lowest bin
                 offset = 0;
                 // Need to add bins below
-                return ExtensionInfo::createShift(oldNBins, std::abs(idx));
+                return ExtensionInfo::createShift(oldNBins, nBelow);
             }
             else
             {
+                std::size_t nAbove = idx - m_nBins + 1;
                 // Now change the internal parameters
-                m_max += binWidth() * idx;
-                m_nBins += idx;
+                m_max += width * nAbove;
+                m_nBins += nAbove;
+                updateInvBinWidth();
                 // New value is in the highest bin
                 offset = nBins() - 1;
                 // Bins are created above so old indices stay the same
@@ -225,7 +350,7 @@ namespace H5Histograms
             std::pair<long, long> nBelowAbove = ::nBelowAbove(*this, other);
             if (nBelowAbove.first > 0 || nBelowAbove.second < 0)
                 throw std::invalid_argument("Other axis extends further than this one");
-            return ExtensionInfo::createShift(std::abs(nBelowAbove.first));
+            return ExtensionInfo::createShift(other.fullNBins(), std::abs(nBelowAbove.first));
         }
         default:
             throw std::logic_error("Invalid enum value");
@@ -233,8 +358,75 @@ namespace H5Histograms
                 
     }
 
+    IAxis::ExtensionInfo FixedBinAxis::mergeAxis(const IAxis &_other)
+    {
+        const FixedBinAxis &other = dynamic_cast<const FixedBinAxis &>(_other);
+        if (m_label != other.m_label)
+            throw std::invalid_argument("Axis labels do not match '" + m_label + "' != '" + other.m_label + "'");
+        if (m_extension != other.m_extension)
+            throw std::invalid_argument("Extension does not match!");
+        std::size_t oldNBins = fullNBins();
+        if (m_nBins == other.m_nBins && m_min == other.m_min && m_max == other.m_max)
+            return ExtensionInfo::createIdentity(oldNBins);
+        switch(m_extension)
+        {
+        case ExtensionType::NoExtension:
+            throw std::invalid_argument("Parameters do not match on non-extendable axis");
+        case ExtensionType::PreserveNBins:
+            throw std::logic_error("Not implemented!");
+        case ExtensionType::PreserveBinWidth:
+        {
+            std::pair<long, long> nBelowAbove = ::nBelowAbove(*this, other);
+            double width = binWidth();
+            std::size_t shift = 0;
+            if (nBelowAbove.first > 0)
+            {
+                // our min is more than theirs
+                shift = nBelowAbove.first;
+                m_min -= shift * width;
+                m_nBins += shift;
+            }
+            if (nBelowAbove.second < 0)
+            {
+                // our max is less than theirs
+                m_max += std::abs(nBelowAbove.second) * width;
+                m_nBins += std::abs(nBelowAbove.second);
+            }
+            updateInvBinWidth();
+            return ExtensionInfo::createShift(oldNBins, shift);
+        }
+        default:
+            throw std::logic_error("Invalid enum value");
+        }
+    }
+
+    std::unique_ptr<IAxis> FixedBinAxis::slice(std::size_t first, std::size_t last, std::size_t &offset) const
+    {
+        if (first >= last || last > fullNBins())
+            throw std::out_of_range("Invalid bin range for axis '" + m_label + "'");
+        // Extendable axes have no flow bins
+        std::size_t flow = isExtendable() ? 0 : 1;
+        std::size_t firstBin = std::max(first, flow) - flow;
+        std::size_t lastBin = std::min(last - flow, m_nBins);
+        if (firstBin >= lastBin)
+            throw std::invalid_argument("Bin range for axis '" + m_label + "' holds no non-overflow bins");
+        offset = first < flow ? 0 : flow;
+        double width = binWidth();
+        return std::make_unique<FixedBinAxis>(
+            m_label,
+            lastBin - firstBin,
+            firstBin == 0 ? m_min : m_min + firstBin * width,
+            lastBin == m_nBins ? m_max : m_min + lastBin * width,
+            m_extension);
+    }
+
     double FixedBinAxis::binWidth() const
     {
         return (m_max - m_min) / m_nBins;
     }
+
+    void FixedBinAxis::updateInvBinWidth()
+    {
+        m_invBinWidth = m_nBins / (m_max - m_min);
+    }
 }
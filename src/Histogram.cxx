@@ -1,7 +1,120 @@
 #include "H5Histograms/Histogram.h"
+#include "H5Histograms/CategoryAxis.h"
+#include "H5Histograms/SparseHistogram.h"
 #include "H5Composites/FixedLengthVectorTraits.h"
 
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
 namespace {
+    /// The number of events for which the batched fill calculates offsets in one go
+    constexpr std::size_t fillBlockSize = 256;
+
+    /// The smallest number of values that each thread is given when adding arrays
+    constexpr std::size_t minAddChunk = std::size_t(1) << 20;
+
+    /// A run of consecutive bins written in a delta, see Histogram::writeCheckpoint
+    struct DeltaRun
+    {
+        /// The offset of the first bin, in the layout of the written bins
+        hsize_t first;
+        hsize_t size;
+        /// The position of the first value in the delta values, so values orphaned by a failed
+        /// write are never read
+        hsize_t valuesFirst;
+        /// Whether each count is followed by its sumW2 in the delta values
+        unsigned char weighted;
+    };
+
+    const H5::CompType &deltaRunDType()
+    {
+        static H5::CompType dtype = [] {
+            H5::CompType dtype(sizeof(DeltaRun));
+            dtype.insertMember("first", HOFFSET(DeltaRun, first), H5::PredType::NATIVE_HSIZE);
+            dtype.insertMember("size", HOFFSET(DeltaRun, size), H5::PredType::NATIVE_HSIZE);
+            dtype.insertMember("valuesFirst", HOFFSET(DeltaRun, valuesFirst), H5::PredType::NATIVE_HSIZE);
+            dtype.insertMember("weighted", HOFFSET(DeltaRun, weighted), H5::PredType::NATIVE_UCHAR);
+            return dtype;
+        }();
+        return dtype;
+    }
+
+    /// Append to a one dimensional dataset, creating it as an extendable, chunked dataset if it does not exist
+    void appendRows(
+        H5::Group &group, const std::string &name, const H5::DataType &dtype, hsize_t n, const void *buffer,
+        const H5Histograms::ChunkedLayout &layout)
+    {
+        H5::DataSet dataSet;
+        hsize_t nWritten = 0;
+        if (group.nameExists(name))
+        {
+            dataSet = group.openDataSet(name);
+            nWritten = dataSet.getSpace().getSimpleExtentNpoints();
+        }
+        else
+        {
+            H5Histograms::ChunkedLayout rowLayout = layout;
+            rowLayout.chunkDims = {std::max<hsize_t>(H5Histograms::ChunkedLayout::defaultChunkBytes / dtype.getSize(), 1)};
+            hsize_t maxDim = H5S_UNLIMITED;
+            dataSet = group.createDataSet(
+                name, dtype, H5::DataSpace(1, &nWritten, &maxDim), rowLayout.createPropList({nWritten}, dtype.getSize()));
+        }
+        if (n == 0)
+            return;
+        hsize_t size = nWritten + n;
+        dataSet.extend(&size);
+        H5::DataSpace fileSpace = dataSet.getSpace();
+        fileSpace.selectHyperslab(H5S_SELECT_SET, &n, &nWritten);
+        dataSet.write(buffer, dtype, H5::DataSpace(1, &n), fileSpace);
+    }
+
+    /**
+     * @brief The name to read a histogram from
+     *
+     * A checkpoint rewrite interrupted after dropping the old group leaves the new one, which is
+     * complete, under the partial name. See Histogram::writeCheckpoint
+     */
+    std::string readableName(const H5::Group &location, const std::string &name)
+    {
+        std::string partial = name + H5Histograms::ChunkedLayout::partialSuffix;
+        return !location.nameExists(name) && location.nameExists(partial) ? partial : name;
+    }
+
+    /// Read the whole of a one dimensional dataset
+    template <typename T>
+    std::vector<T> readRows(const H5::Group &group, const std::string &name, const H5::DataType &dtype)
+    {
+        H5::DataSet dataSet = group.openDataSet(name);
+        std::vector<T> rows(dataSet.getSpace().getSimpleExtentNpoints());
+        if (!rows.empty())
+            dataSet.read(rows.data(), dtype);
+        return rows;
+    }
+
+    /// Add one array onto another, splitting large arrays between at most nThreads threads
+    template <typename STORAGE>
+    void addArrays(STORAGE *target, const STORAGE *source, std::size_t n, std::size_t maxThreads = 1)
+    {
+        std::size_t nThreads = std::min<std::size_t>(maxThreads, n / minAddChunk);
+        if (nThreads <= 1)
+        {
+            for (std::size_t idx = 0; idx < n; ++idx)
+                target[idx] += source[idx];
+            return;
+        }
+        std::size_t chunk = (n + nThreads - 1) / nThreads;
+        std::vector<std::thread> threads;
+        threads.reserve(nThreads - 1);
+        for (std::size_t first = chunk; first < n; first += chunk)
+            threads.emplace_back(addArrays<STORAGE>, target + first, source + first, std::min(chunk, n - first), 1);
+        // This thread takes the first chunk
+        addArrays(target, source, chunk);
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
     template <typename STORAGE>
     std::pair<STORAGE, STORAGE> mkPair(const STORAGE &first, const STORAGE &second)
     {
@@ -13,6 +126,55 @@ namespace {
     {
         return std::make_pair(std::ref(first), std::ref(second));
     }
+
+    /**
+     * @brief Visit each row along the innermost axis of bins being mapped onto new storage
+     *
+     * @param sizes The number of bins along each axis of the source
+     * @param fromStrides The strides of the source storage
+     * @param fromBase The source storage offset of the first bin
+     * @param toStrides The strides of the target storage
+     * @param toBase The target storage offset of the first bin
+     * @param extensions How each axis maps onto the target
+     * @param f Called with the source and target storage offsets of the start of each row. The
+     *        target offset does not include the mapping of the innermost axis
+     */
+    template <typename FUNC>
+    void forEachRow(
+        const std::vector<std::size_t> &sizes,
+        const std::vector<std::size_t> &fromStrides,
+        std::size_t fromBase,
+        const std::vector<std::size_t> &toStrides,
+        std::size_t toBase,
+        const std::vector<H5Histograms::IAxis::ExtensionInfo> &extensions,
+        FUNC &&f)
+    {
+        if (std::find(sizes.begin(), sizes.end(), 0) != sizes.end())
+            return;
+        std::size_t nOuter = sizes.empty() ? 0 : sizes.size() - 1;
+        std::vector<std::size_t> pos(nOuter, 0);
+        while (true)
+        {
+            std::size_t from = fromBase;
+            std::size_t to = toBase;
+            for (std::size_t idx = 0; idx < nOuter; ++idx)
+            {
+                from += pos[idx] * fromStrides[idx];
+                to += extensions[idx].newOffset(pos[idx]) * toStrides[idx];
+            }
+            f(from, to);
+            // Step to the next row in row-major order
+            std::size_t idx = nOuter;
+            for (; idx > 0; --idx)
+            {
+                if (++pos[idx - 1] < sizes[idx - 1])
+                    break;
+                pos[idx - 1] = 0;
+            }
+            if (idx == 0)
+                return;
+        }
+    }
 }
 
 namespace H5Histograms
@@ -26,8 +188,7 @@ namespace H5Histograms
         {
             definition.template add<H5Composites::FLVector<IAxisUPtr>>(&Histogram::m_axes, "axes");
             definition.template add(&Histogram::m_nEntries, "nEntries");
-            definition.template add<H5Composites::FLVector<STORAGE>>(&Histogram::m_counts, "counts");
-            definition.template add<H5Composites::FLVector<STORAGE>>(&Histogram::m_sumW2, "sumW2");
+            // The bin contents are written by hand as they are stored interleaved
             init = true;
         }
         return definition;
@@ -38,9 +199,10 @@ namespace H5Histograms
     Histogram<STORAGE>::Iterator<CONST>::Iterator(histogram_t &histogram)
         : m_idxItr(histogram.m_indexer.begin()),
           m_histo(histogram),
-          m_offset(0),
-          m_value(std::tie(histogram.m_counts.front(), histogram.m_sumW2.front()))
+          m_offset(0)
     {
+        if (histogram.fullNBins() > 0)
+            m_value.emplace(valueAt(histogram.storageOffset(*m_idxItr)));
     }
 
     template <typename STORAGE>
@@ -48,9 +210,11 @@ namespace H5Histograms
     Histogram<STORAGE>::Iterator<CONST>::Iterator(histogram_t &histogram, const Histogram::value_t &values)
         : m_idxItr(histogram.m_indexer.axisSizes(), histogram.axisOffsetsFromValues(values)),
           m_histo(histogram),
-          m_offset(m_idxItr.offset()),
-          m_value(std::tie(histogram.m_counts.at(m_offset), histogram.m_sumW2.at(m_offset)))
+          m_offset(m_idxItr.offset())
     {
+        if (m_offset >= histogram.fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        m_value.emplace(valueAt(histogram.storageOffset(*m_idxItr)));
     }
 
     template <typename STORAGE>
@@ -105,11 +269,11 @@ namespace H5Histograms
     {
         ++m_idxItr;
         ++m_offset;
-        if (m_offset == m_histo.m_counts.size())
+        if (m_offset == m_histo.fullNBins())
             // exhausted
             m_value.reset();
         else
-            m_value = std::tie(m_histo.m_counts[m_offset], m_histo.m_sumW2[m_offset]);
+            m_value.emplace(valueAt(m_histo.storageOffset(*m_idxItr)));
         return *this;
     }
 
@@ -129,7 +293,7 @@ namespace H5Histograms
         // Will throw an exception if we're going past the beginning
         --m_idxItr;
         --m_offset;
-        m_value = std::tie(m_histo.m_counts[m_offset], m_histo.m_sumW2[m_offset]);
+        m_value.emplace(valueAt(m_histo.storageOffset(*m_idxItr)));
         return *this;
     }
 
@@ -143,69 +307,613 @@ namespace H5Histograms
     }
 
     template <typename STORAGE>
-    Histogram<STORAGE>::Histogram(const void *buffer, const H5::DataType &dtype) : HistogramBase({})
+    template <bool CONST>
+    typename Histogram<STORAGE>::template Iterator<CONST>::value_type Histogram<STORAGE>::Iterator<CONST>::valueAt(
+        std::size_t offset) const
     {
+        if constexpr (CONST)
+            return value_type(m_histo.countAt(offset), m_histo.sumW2At(offset));
+        else
+            return value_type(BinReference<false>(m_histo, offset), BinReference<true>(m_histo, offset));
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE>::Histogram(
+        const void *buffer, const H5::DataType &dtype, std::pmr::memory_resource *resource)
+        : HistogramBase({}), m_values(resource), m_storage({}), m_base(0)
+    {
+        if (isSparse(dtype))
+            throw std::invalid_argument("Data type describes a sparse histogram");
         compositeDefinition().readBuffer(*this, buffer, dtype);
         calculateStrides();
+        resetStorage();
+        m_weighted = storesSumW2(dtype);
+        std::size_t n = fullNBins();
+        m_values.resize(n);
+        readBinArray(buffer, dtype, "counts", nativeDType<STORAGE>(), m_values.data(), n);
+        if (m_weighted)
+        {
+            std::vector<STORAGE> sumW2(n);
+            readBinArray(buffer, dtype, "sumW2", nativeDType<STORAGE>(), sumW2.data(), n);
+            interleave(sumW2);
+        }
     }
 
     template <typename STORAGE>
-    Histogram<STORAGE>::Histogram(std::vector<std::unique_ptr<IAxis>> &&axes)
+    Histogram<STORAGE>::Histogram(std::vector<std::unique_ptr<IAxis>> &&axes, std::pmr::memory_resource *resource)
         : HistogramBase(std::move(axes)),
+          m_weighted(false),
           m_nEntries(0),
-          m_counts(fullNBins(), 0),
-          m_sumW2(fullNBins(), 0)
+          m_values(fullNBins(), 0, resource),
+          m_storage({}),
+          m_base(0)
     {
+        resetStorage();
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE>::Histogram(
+        std::vector<std::unique_ptr<IAxis>> &&axes,
+        const std::vector<STORAGE> &counts,
+        const std::vector<STORAGE> &sumW2,
+        std::size_t nEntries,
+        std::pmr::memory_resource *resource)
+        : HistogramBase(std::move(axes)),
+          m_weighted(false),
+          m_nEntries(nEntries),
+          m_values(counts.begin(), counts.end(), resource),
+          m_storage({}),
+          m_base(0)
+    {
+        resetStorage();
+        if (counts.size() != fullNBins() || (!sumW2.empty() && sumW2.size() != fullNBins()))
+            throw std::invalid_argument("Number of bin contents does not match the axes");
+        if (!sumW2.empty())
+        {
+            m_weighted = true;
+            interleave(sumW2);
+        }
     }
 
     template <typename STORAGE>
     H5::DataType Histogram<STORAGE>::h5DType() const
     {
-        return compositeDefinition().dtype(*this);
+        return appendBinArrays(compositeDefinition().dtype(*this), nativeDType<STORAGE>(), m_weighted);
     }
 
     template <typename STORAGE>
     void Histogram<STORAGE>::writeBuffer(void *buffer) const
+    {
+        writeBufferWithDType(buffer, h5DType());
+    }
+
+    template <typename STORAGE>
+    std::string Histogram<STORAGE>::dtypeKey() const
+    {
+        return HistogramBase::dtypeKey() + (m_weighted ? "|w" : "|u");
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::writeBufferWithDType(void *buffer, const H5::DataType &h5DType) const
     {
         compositeDefinition().writeBuffer(*this, buffer);
+        H5::CompType dtype(h5DType.getId());
+        char *counts = static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("counts"));
+        std::size_t n = fullNBins();
+        if (!m_weighted && !hasHeadroom())
+        {
+            std::memcpy(counts, m_values.data(), n * sizeof(STORAGE));
+            return;
+        }
+        char *sumW2 = m_weighted
+            ? static_cast<char *>(buffer) + dtype.getMemberOffset(dtype.getMemberIndex("sumW2"))
+            : nullptr;
+        if (!hasHeadroom())
+        {
+            // Separate the interleaved values into the counts and sumW2 arrays
+            for (std::size_t idx = 0; idx < n; ++idx)
+            {
+                std::memcpy(counts + idx * sizeof(STORAGE), &m_values[2 * idx], sizeof(STORAGE));
+                std::memcpy(sumW2 + idx * sizeof(STORAGE), &m_values[2 * idx + 1], sizeof(STORAGE));
+            }
+            return;
+        }
+        if (n == 0)
+            return;
+        // Leave out the headroom
+        std::size_t idx = 0;
+        for (const std::vector<std::size_t> &axisOffsets : m_indexer)
+        {
+            std::size_t offset = storageOffset(axisOffsets);
+            std::memcpy(counts + idx * sizeof(STORAGE), &countAt(offset), sizeof(STORAGE));
+            if (m_weighted)
+                std::memcpy(sumW2 + idx * sizeof(STORAGE), &sumW2At(offset), sizeof(STORAGE));
+            ++idx;
+        }
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::read(
+        const H5::Group &location, const std::string &_name, std::pmr::memory_resource *resource)
+    {
+        std::string name = readableName(location, _name);
+        if (location.childObjType(name) == H5O_TYPE_DATASET)
+        {
+            // The whole histogram is a single element
+            H5::DataSet dataSet = location.openDataSet(name);
+            H5::DataType dtype = dataSet.getDataType();
+            std::vector<char> buffer(dtype.getSize());
+            dataSet.read(buffer.data(), dtype);
+            if (!isSparse(dtype))
+                return Histogram(buffer.data(), dtype, resource);
+            SparseHistogram<STORAGE> sparse(buffer.data(), dtype);
+            Histogram h(sparse.cloneAxes(), resource);
+            h += sparse;
+            return h;
+        }
+        H5::Group group = location.openGroup(name);
+        Histogram h = readHeader(group, resource);
+        h.m_weighted = group.nameExists(ChunkedLayout::sumW2Name);
+        h.m_values.assign((h.m_weighted ? 2 : 1) * h.fullNBins(), 0);
+        std::vector<std::size_t> zeros(h.nDims(), 0);
+        h.readBins(
+            group.openDataSet(ChunkedLayout::countsName), false, h.fullNBins(), zeros, zeros, h.m_indexer.axisSizes());
+        if (h.m_weighted)
+            h.readBins(
+                group.openDataSet(ChunkedLayout::sumW2Name), true, h.fullNBins(), zeros, zeros, h.m_indexer.axisSizes());
+        h.applyDeltas(group, h.m_indexer, nullptr, zeros);
+        return h;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::readRegion(
+        const H5::Group &location,
+        const std::string &name,
+        const std::vector<bin_range_t> &ranges,
+        std::pmr::memory_resource *resource)
+    {
+        return readRegion(location, name, [&ranges](const HistogramBase &) { return ranges; }, resource);
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::readBox(
+        const H5::Group &location,
+        const std::string &name,
+        const std::vector<std::pair<IAxis::value_t, IAxis::value_t>> &box,
+        std::pmr::memory_resource *resource)
+    {
+        return readRegion(location, name, [&box](const HistogramBase &h) { return h.binRanges(box); }, resource);
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::readRegion(
+        const H5::Group &location,
+        const std::string &_name,
+        const std::function<std::vector<bin_range_t>(const HistogramBase &)> &region,
+        std::pmr::memory_resource *resource)
+    {
+        std::string name = readableName(location, _name);
+        if (location.childObjType(name) == H5O_TYPE_DATASET)
+        {
+            // Only the chunked layout can be read in part
+            Histogram h = read(location, name, resource);
+            return h.slice(region(h));
+        }
+        H5::Group group = location.openGroup(name);
+        Histogram header = readHeader(group, resource);
+        std::vector<bin_range_t> ranges = region(header);
+        std::vector<std::size_t> offsets;
+        Histogram h(sliceAxes(header.m_axes, ranges, offsets), resource);
+        h.m_nEntries = header.m_nEntries;
+        std::vector<std::size_t> fileFirst;
+        std::vector<std::size_t> count;
+        for (const bin_range_t &range : ranges)
+        {
+            fileFirst.push_back(range.first);
+            count.push_back(range.second - range.first);
+        }
+        h.readBins(group.openDataSet(ChunkedLayout::countsName), false, header.fullNBins(), fileFirst, offsets, count);
+        if (group.nameExists(ChunkedLayout::sumW2Name))
+        {
+            h.makeWeighted();
+            h.readBins(group.openDataSet(ChunkedLayout::sumW2Name), true, header.fullNBins(), fileFirst, offsets, count);
+        }
+        h.applyDeltas(group, header.m_indexer, &ranges, offsets);
+        return h;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::writeChunked(H5::Group &location, const std::string &name, const ChunkedLayout &layout) const
+    {
+        H5::Group group = location.createGroup(name);
+        H5::DataType headerType = compositeDefinition().dtype(*this);
+        std::vector<char> header(headerType.getSize());
+        compositeDefinition().writeBuffer(*this, header.data());
+        group.createDataSet(ChunkedLayout::headerName, headerType, H5::DataSpace()).write(header.data(), headerType);
+        std::vector<hsize_t> dims(m_indexer.axisSizes().begin(), m_indexer.axisSizes().end());
+        // Scalar datasets cannot be chunked
+        if (dims.empty())
+            dims.push_back(1);
+        H5::DataSpace fileSpace(dims.size(), dims.data());
+        H5::DSetCreatPropList propList = layout.createPropList(dims, sizeof(STORAGE));
+        H5::DataSet counts = group.createDataSet(ChunkedLayout::countsName, nativeDType<STORAGE>(), fileSpace, propList);
+        std::vector<std::size_t> zeros(nDims(), 0);
+        if (fullNBins() > 0)
+            counts.write(
+                m_values.data(), nativeDType<STORAGE>(), storageSpace(false, zeros, m_indexer.axisSizes()), fileSpace);
+        if (m_weighted)
+        {
+            H5::DataSet sumW2 = group.createDataSet(ChunkedLayout::sumW2Name, nativeDType<STORAGE>(), fileSpace, propList);
+            if (fullNBins() > 0)
+                sumW2.write(
+                    m_values.data(), nativeDType<STORAGE>(), storageSpace(true, zeros, m_indexer.axisSizes()), fileSpace);
+        }
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::trackChanges(std::size_t blockBins)
+    {
+        if (blockBins == 0 || (blockBins & (blockBins - 1)) != 0)
+            throw std::invalid_argument("Block size must be a power of 2");
+        m_blockShift = 0;
+        while ((std::size_t(1) << m_blockShift) < blockBins)
+            ++m_blockShift;
+        // The extra block means that even a histogram without bins tracks its changes
+        m_changed.assign((m_storage.nEntries() >> m_blockShift) + 1, 0);
+        m_axesChanged = false;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::clearChanges()
+    {
+        std::fill(m_changed.begin(), m_changed.end(), 0);
+        m_axesChanged = false;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::writeCheckpoint(H5::Group &location, const std::string &name, const ChunkedLayout &layout)
+    {
+        std::string partial = name + ChunkedLayout::partialSuffix;
+        // Finish a rewrite that was interrupted after the old base was dropped
+        if (!location.nameExists(name) && location.nameExists(partial))
+            location.moveLink(partial, name);
+        bool rewrite = !tracksChanges() || m_axesChanged || !location.nameExists(name) ||
+            location.childObjType(name) != H5O_TYPE_GROUP;
+        if (!rewrite)
+        {
+            H5::Group group = location.openGroup(name);
+            // Only write a delta on top of a base with these bins, and only while that is smaller
+            // than writing a new base
+            hsize_t nWrittenBins = group.openDataSet(ChunkedLayout::countsName).getSpace().getSimpleExtentNpoints();
+            hsize_t nDeltaValues = group.nameExists(ChunkedLayout::deltaValuesName)
+                ? group.openDataSet(ChunkedLayout::deltaValuesName).getSpace().getSimpleExtentNpoints()
+                : 0;
+            rewrite = nWrittenBins != std::max<std::size_t>(fullNBins(), 1) ||
+                nDeltaValues >= (m_weighted ? 2 : 1) * fullNBins();
+            if (!rewrite)
+            {
+                try
+                {
+                    writeDelta(group, layout);
+                }
+                catch (...)
+                {
+                    // The changes are kept but part of the delta may have been written, so start
+                    // again from a fresh base next time
+                    m_axesChanged = true;
+                    throw;
+                }
+            }
+        }
+        if (rewrite && !location.nameExists(name))
+            // There is no earlier checkpoint to keep
+            writeChunked(location, name, layout);
+        else if (rewrite)
+        {
+            // Write the new base alongside the old one, which is only dropped once the new one is
+            // complete. So the partial name only holds a base without the old one if it is complete
+            if (location.nameExists(partial))
+                location.unlink(partial);
+            writeChunked(location, partial, layout);
+            location.unlink(name);
+            location.moveLink(partial, name);
+        }
+        clearChanges();
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::markChanged(std::size_t first, std::size_t last)
+    {
+        if (!m_changed.empty() && first < last)
+            std::fill(m_changed.begin() + (first >> m_blockShift), m_changed.begin() + ((last - 1) >> m_blockShift) + 1, 1);
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::writeDelta(H5::Group &group, const ChunkedLayout &layout) const
+    {
+        std::size_t stride = m_weighted ? 2 : 1;
+        std::vector<DeltaRun> runs;
+        std::vector<STORAGE> values;
+        hsize_t nWrittenValues = group.nameExists(ChunkedLayout::deltaValuesName)
+            ? group.openDataSet(ChunkedLayout::deltaValuesName).getSpace().getSimpleExtentNpoints()
+            : 0;
+        // Add bins at consecutive storage offsets, which must also be consecutive in the written layout
+        auto addBins = [&](std::size_t offset, std::size_t storageOffset, std::size_t n) {
+            if (!runs.empty() && runs.back().first + runs.back().size == offset)
+                runs.back().size += n;
+            else
+                runs.push_back({offset, n, nWrittenValues + values.size(), m_weighted});
+            values.insert(
+                values.end(), m_values.begin() + storageOffset * stride, m_values.begin() + (storageOffset + n) * stride);
+        };
+        std::size_t nStorage = m_storage.nEntries();
+        for (std::size_t block = 0; block < m_changed.size(); ++block)
+        {
+            if (!m_changed[block])
+                continue;
+            std::size_t first = std::min(block << m_blockShift, nStorage);
+            std::size_t last = std::min((block + 1) << m_blockShift, nStorage);
+            if (!hasHeadroom())
+            {
+                if (first < last)
+                    addBins(first, first, last - first);
+                continue;
+            }
+            // Leave out the headroom
+            for (std::size_t storageOffset = first; storageOffset < last; ++storageOffset)
+            {
+                std::vector<std::size_t> axisOffsets = m_storage.axisOffsets(storageOffset);
+                bool inAxes = true;
+                for (std::size_t idx = 0; idx < nDims() && inAxes; ++idx)
+                {
+                    inAxes = axisOffsets[idx] >= m_origins[idx] &&
+                        axisOffsets[idx] - m_origins[idx] < m_indexer.axisSizes()[idx];
+                    axisOffsets[idx] -= m_origins[idx];
+                }
+                if (inAxes)
+                    addBins(m_indexer.offset(axisOffsets), storageOffset, 1);
+            }
+        }
+        // The runs are written after the values they point to, so only complete deltas are applied
+        appendRows(group, ChunkedLayout::deltaValuesName, nativeDType<STORAGE>(), values.size(), values.data(), layout);
+        appendRows(group, ChunkedLayout::deltaRunsName, deltaRunDType(), runs.size(), runs.data(), layout);
+        hsize_t nEntries = m_nEntries;
+        appendRows(group, ChunkedLayout::deltaEntriesName, H5::PredType::NATIVE_HSIZE, 1, &nEntries, layout);
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::applyDeltas(
+        const H5::Group &group,
+        const ArrayIndexer &fileIndexer,
+        const std::vector<bin_range_t> *ranges,
+        const std::vector<std::size_t> &offsets)
+    {
+        if (!group.nameExists(ChunkedLayout::deltaRunsName))
+            return;
+        std::vector<DeltaRun> runs = readRows<DeltaRun>(group, ChunkedLayout::deltaRunsName, deltaRunDType());
+        std::vector<STORAGE> values = readRows<STORAGE>(group, ChunkedLayout::deltaValuesName, nativeDType<STORAGE>());
+        std::vector<hsize_t> nEntries = readRows<hsize_t>(
+            group, ChunkedLayout::deltaEntriesName, H5::PredType::NATIVE_HSIZE);
+        if (!nEntries.empty())
+            m_nEntries = nEntries.back();
+        // Later deltas hold the newer contents so are applied last
+        for (const DeltaRun &run : runs)
+        {
+            std::size_t stride = run.weighted ? 2 : 1;
+            if (run.valuesFirst > values.size() || values.size() - run.valuesFirst < run.size * stride)
+                throw std::invalid_argument("Delta values do not match the runs");
+            const STORAGE *value = values.data() + run.valuesFirst;
+            if (run.first + run.size > fileIndexer.nEntries())
+                throw std::out_of_range("Delta bin offset out of range");
+            if (run.weighted)
+                makeWeighted();
+            for (std::size_t idx = 0; idx < run.size; ++idx, value += stride)
+            {
+                std::size_t offset = run.first + idx;
+                if (ranges)
+                {
+                    std::vector<std::size_t> axisOffsets = fileIndexer.axisOffsets(offset);
+                    bool inRegion = true;
+                    for (std::size_t iAxis = 0; iAxis < nDims() && inRegion; ++iAxis)
+                    {
+                        const bin_range_t &range = (*ranges)[iAxis];
+                        inRegion = axisOffsets[iAxis] >= range.first && axisOffsets[iAxis] < range.second;
+                        axisOffsets[iAxis] = axisOffsets[iAxis] - range.first + offsets[iAxis];
+                    }
+                    if (!inRegion)
+                        continue;
+                    offset = storageOffset(axisOffsets);
+                }
+                // Unweighted runs have a sumW2 equal to their counts
+                countAt(offset) = value[0];
+                sumW2At(offset) = value[stride - 1];
+            }
+        }
     }
 
     template <typename STORAGE>
     void Histogram<STORAGE>::fill(const value_t &values, STORAGE weight)
     {
-        std::size_t offset = binOffsetFromValues(values);
+        std::size_t offset = storageOffset(axisOffsetsFromValues(values));
         if (offset == SIZE_MAX)
         {
             std::vector<IAxis::ExtensionInfo> extensions = extendAxes(values, offset);
             resize(extensions);
+            // The offset from extendAxes does not include the headroom
+            offset = storageOffset(m_indexer.axisOffsets(offset));
         }
-        m_counts.at(offset) += weight;
-        m_sumW2.at(offset) += weight * weight;
+        if (offset >= m_storage.nEntries())
+            throw std::out_of_range("Bin offset out of range");
+        add(offset, weight);
         ++m_nEntries;
     }
 
     template <typename STORAGE>
-    STORAGE &Histogram<STORAGE>::contents(const index_t &indices)
+    void Histogram<STORAGE>::fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight)
     {
-        return m_counts.at(binOffsetFromIndices(indices));
+        std::size_t offset = binOffsetFromValues(values, nValues, m_storage.strides());
+        if (offset == SIZE_MAX)
+        {
+            // Extending an axis is rare enough that it can go through the owning values
+            std::vector<IAxis::ExtensionInfo> extensions = extendAxes(ownedValues(values, nValues), offset);
+            resize(extensions);
+            // The offset from extendAxes does not include the headroom
+            offset = storageOffset(m_indexer.axisOffsets(offset));
+        }
+        else
+            offset += m_base;
+        add(offset, weight);
+        ++m_nEntries;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::fillColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t nEvents,
+        const STORAGE *weights)
+    {
+        std::array<std::size_t, fillBlockSize> offsets;
+        std::array<std::size_t, fillBlockSize> scratch;
+        std::size_t first = 0;
+        while (first < nEvents)
+        {
+            std::size_t n = std::min(nEvents - first, fillBlockSize);
+            binOffsetsFromColumns(columns, first, n, offsets.data(), scratch.data(), m_storage.strides());
+            // Only fill up to the first event that has no bin
+            std::size_t nValid = std::find(offsets.begin(), offsets.begin() + n, SIZE_MAX) - offsets.begin();
+            for (std::size_t idx = 0; idx < nValid; ++idx)
+                offsets[idx] += m_base;
+            const STORAGE *blockWeights = weights ? weights + first : nullptr;
+            if (blockWeights && !m_weighted &&
+                std::any_of(blockWeights, blockWeights + nValid, [](STORAGE w) { return w != 1; }))
+                makeWeighted();
+            if (!m_weighted)
+            {
+                // Every weight in this block is 1
+                for (std::size_t idx = 0; idx < nValid; ++idx)
+                    m_values[offsets[idx]] += 1;
+            }
+            else if (blockWeights)
+            {
+                for (std::size_t idx = 0; idx < nValid; ++idx)
+                {
+                    m_values[2 * offsets[idx]] += blockWeights[idx];
+                    m_values[2 * offsets[idx] + 1] += blockWeights[idx] * blockWeights[idx];
+                }
+            }
+            else
+            {
+                for (std::size_t idx = 0; idx < nValid; ++idx)
+                {
+                    m_values[2 * offsets[idx]] += 1;
+                    m_values[2 * offsets[idx] + 1] += 1;
+                }
+            }
+            if (tracksChanges())
+                for (std::size_t idx = 0; idx < nValid; ++idx)
+                    markChanged(offsets[idx]);
+            m_nEntries += nValid;
+            first += nValid;
+            if (nValid != n)
+            {
+                // Extending an axis changes the offsets of every later event so fill this one on
+                // its own and restart the block after it
+                fill(valuesFromColumns(columns, first), weights ? weights[first] : 1);
+                ++first;
+            }
+        }
+    }
+
+    template <typename STORAGE>
+    IAxis::CategoryToken Histogram<STORAGE>::token(std::size_t idx, const std::string &category)
+    {
+        const CategoryAxis *categoryAxis = dynamic_cast<const CategoryAxis *>(&axis(idx));
+        if (!categoryAxis)
+            throw std::invalid_argument("Axis '" + axis(idx).label() + "' is not a category axis");
+        if (categoryAxis->isExtendable() && !categoryAxis->containsValue(category))
+            resize(extendAxis(idx, category));
+        return categoryAxis->token(category);
+    }
+
+    template <typename STORAGE>
+    typename Histogram<STORAGE>::template BinReference<false> Histogram<STORAGE>::contents(const index_t &indices)
+    {
+        return BinReference<false>(*this, checkedOffset(indices));
     }
 
     template <typename STORAGE>
     STORAGE Histogram<STORAGE>::contents(const index_t &indices) const
     {
-        return m_counts.at(binOffsetFromIndices(indices));
+        return countAt(checkedOffset(indices));
     }
 
     template <typename STORAGE>
-    STORAGE &Histogram<STORAGE>::sumW2(const index_t &indices)
+    typename Histogram<STORAGE>::template BinReference<true> Histogram<STORAGE>::sumW2(const index_t &indices)
     {
-        return m_sumW2.at(binOffsetFromIndices(indices));
+        return BinReference<true>(*this, checkedOffset(indices));
     }
 
     template <typename STORAGE>
     STORAGE Histogram<STORAGE>::sumW2(const index_t &indices) const
     {
-        return m_sumW2.at(binOffsetFromIndices(indices));
+        return sumW2At(checkedOffset(indices));
+    }
+
+    template <typename STORAGE>
+    template <typename T>
+    void Histogram<STORAGE>::addBins(
+        const std::vector<std::size_t> &sizes,
+        const std::vector<std::size_t> &strides,
+        std::size_t base,
+        const std::vector<IAxis::ExtensionInfo> &extensions,
+        const T *counts,
+        const T *sumW2,
+        std::size_t step,
+        std::pair<std::size_t, std::size_t> rows)
+    {
+        const IAxis::ExtensionInfo *inner = sizes.empty() ? nullptr : &extensions.back();
+        std::size_t rowSize = sizes.empty() ? 1 : sizes.back();
+        std::size_t stride = m_weighted ? 2 : 1;
+        // Rows can be added element by element if they are laid out the same way
+        bool sameLayout = false;
+        if constexpr (std::is_same_v<T, STORAGE>)
+            sameLayout = (!inner || inner->isShift()) && step == stride &&
+                (m_weighted ? sumW2 == counts + 1 : !sumW2);
+        std::size_t storageRow = storageRowSize();
+        forEachRow(
+            sizes, strides, base, m_storage.strides(), m_base, extensions,
+            [&](std::size_t from, std::size_t to) {
+                // Rows start at a multiple of the row size, before any headroom along the innermost axis
+                if (to / storageRow < rows.first || to / storageRow >= rows.second)
+                    return;
+                markChanged(to, to + storageRow);
+                if constexpr (std::is_same_v<T, STORAGE>)
+                    if (sameLayout)
+                    {
+                        addArrays(
+                            m_values.data() + (to + (inner ? inner->shift : 0)) * stride,
+                            counts + from * step,
+                            rowSize * step);
+                        return;
+                    }
+                for (std::size_t idx = 0; idx < rowSize; ++idx)
+                {
+                    std::size_t offset = to + (inner ? inner->newOffset(idx) : 0);
+                    std::size_t source = (from + idx) * step;
+                    countAt(offset) += static_cast<STORAGE>(counts[source]);
+                    if (m_weighted)
+                        sumW2At(offset) += static_cast<STORAGE>(sumW2 ? sumW2[source] : counts[source]);
+                }
+            });
+    }
+
+    template <typename STORAGE>
+    std::size_t Histogram<STORAGE>::checkedOffset(const index_t &indices) const
+    {
+        std::size_t offset = storageOffset(axisOffsetsFromIndices(indices));
+        if (offset == SIZE_MAX)
+            throw std::out_of_range("Bin offset out of range");
+        return offset;
     }
 
     template <typename STORAGE>
@@ -213,32 +921,185 @@ namespace H5Histograms
     {
         if (extensions.size() != nDims())
             throw std::invalid_argument("Number of axis extensions does not match the number of dimensions!");
-        std::vector<STORAGE> oldCounts = std::move(m_counts);
-        std::vector<STORAGE> oldSumW2 = std::move(m_sumW2);
         // Right now the actual axes are updated but the indexer is not
         ArrayIndexer oldIndexer = m_indexer;
         // Now update the indexer
         calculateStrides();
-        std::size_t n = fullNBins();
-        // Make enough space for the new counts
-        m_counts.assign(n, 0);
-        m_sumW2.assign(n, 0);
-        // Need to iterate over every original bin
-        for (const std::vector<std::size_t> &oldOffsets : oldIndexer)
-        {
-            std::size_t oldOffset = oldIndexer.offset_noCheck(oldOffsets);
-            std::vector<std::size_t> newOffsets(nDims());
+        std::vector<std::size_t> sizes = m_storage.axisSizes();
+        std::vector<std::size_t> origins = m_origins;
+        // Whether every bin stays where it is in the storage
+        bool inPlace = true;
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            std::size_t oldSize = oldIndexer.axisSizes()[idx];
+            std::size_t newSize = m_indexer.axisSizes()[idx];
+            // The bins only keep their storage positions if the whole axis is shifted
+            std::size_t shift = extensions[idx].shift;
+            bool shifted = shift != SIZE_MAX;
+            if (shifted && shift <= origins[idx] && origins[idx] - shift + newSize <= sizes[idx])
+            {
+                // The new bins fit in the headroom
+                origins[idx] -= shift;
+                continue;
+            }
+            inPlace = false;
+            // Reserve headroom on each side that grew, new bins are only ever added at the ends
+            std::size_t headroom = std::max<std::size_t>(newSize / 2, 1);
+            origins[idx] = shifted && shift > 0 ? headroom : 0;
+            sizes[idx] = origins[idx] + newSize + (shifted && newSize > oldSize + shift ? headroom : 0);
+        }
+        ArrayIndexer storage(sizes);
+        std::size_t base = 0;
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            base += origins[idx] * storage.strides()[idx];
+        if (!inPlace && oldIndexer.nEntries() > 0)
+        {
             for (std::size_t idx = 0; idx < nDims(); ++idx)
-                newOffsets[idx] = extensions[idx].func(oldOffsets[idx]);
-            std::size_t newOffset = m_indexer.offset_noCheck(newOffsets);
-        
-            m_counts.at(newOffset) += oldCounts[oldOffset];
-            m_sumW2.at(newOffset) += oldSumW2[oldOffset];
+                if (!extensions[idx].fitsInto(m_indexer.axisSizes()[idx]))
+                    throw std::out_of_range("Bin offset out of range");
+            std::size_t stride = m_weighted ? 2 : 1;
+            // Keep using the same memory resource
+            std::pmr::vector<STORAGE> values(storage.nEntries() * stride, 0, m_values.get_allocator());
+            const IAxis::ExtensionInfo *inner = nDims() > 0 ? &extensions.back() : nullptr;
+            std::size_t rowSize = nDims() > 0 ? oldIndexer.axisSizes().back() : 1;
+            forEachRow(
+                oldIndexer.axisSizes(), m_storage.strides(), m_base, storage.strides(), base, extensions,
+                [&](std::size_t from, std::size_t to) {
+                    const STORAGE *source = m_values.data() + from * stride;
+                    if (!inner || inner->isShift())
+                    {
+                        // The whole row moves together, copying the whole stride moves the sumW2
+                        // along with the count
+                        to += inner ? inner->shift : 0;
+                        std::copy(source, source + rowSize * stride, values.data() + to * stride);
+                    }
+                    else
+                        for (std::size_t idx = 0; idx < rowSize; ++idx)
+                            for (std::size_t iValue = 0; iValue < stride; ++iValue)
+                                values[(to + inner->table[idx]) * stride + iValue] += source[idx * stride + iValue];
+                });
+            m_values = std::move(values);
+        }
+        else if (!inPlace)
+            m_values.assign(storage.nEntries() * (m_weighted ? 2 : 1), 0);
+        m_storage = std::move(storage);
+        m_origins = std::move(origins);
+        m_base = base;
+        if (tracksChanges())
+        {
+            // The written bins no longer line up with the axes
+            m_changed.assign((m_storage.nEntries() >> m_blockShift) + 1, 1);
+            m_axesChanged = true;
+        }
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::resetStorage()
+    {
+        m_storage = m_indexer;
+        m_origins.assign(nDims(), 0);
+        m_base = 0;
+    }
+
+    template <typename STORAGE>
+    std::size_t Histogram<STORAGE>::storageOffset(const std::vector<std::size_t> &axisOffsets) const
+    {
+        const std::vector<std::size_t> &axisSizes = m_indexer.axisSizes();
+        const std::vector<std::size_t> &strides = m_storage.strides();
+        std::size_t offset = m_base;
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            if (axisOffsets[idx] >= axisSizes[idx])
+                return SIZE_MAX;
+            offset += axisOffsets[idx] * strides[idx];
+        }
+        return offset;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::readHeader(const H5::Group &group, std::pmr::memory_resource *resource)
+    {
+        H5::DataSet headerSet = group.openDataSet(ChunkedLayout::headerName);
+        H5::DataType headerType = headerSet.getDataType();
+        std::vector<char> header(headerType.getSize());
+        headerSet.read(header.data(), headerType);
+        Histogram h(std::vector<std::unique_ptr<IAxis>>(), resource);
+        compositeDefinition().readBuffer(h, header.data(), headerType);
+        h.calculateStrides();
+        h.resetStorage();
+        h.m_values.clear();
+        return h;
+    }
+
+    template <typename STORAGE>
+    H5::DataSpace Histogram<STORAGE>::storageSpace(
+        bool sumW2, const std::vector<std::size_t> &first, const std::vector<std::size_t> &count) const
+    {
+        std::vector<hsize_t> dims(m_storage.axisSizes().begin(), m_storage.axisSizes().end());
+        std::vector<hsize_t> start;
+        start.reserve(nDims() + 1);
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            start.push_back(m_origins[idx] + first[idx]);
+        std::vector<hsize_t> block(count.begin(), count.end());
+        dims.push_back(m_weighted ? 2 : 1);
+        start.push_back(sumW2 ? 1 : 0);
+        block.push_back(1);
+        H5::DataSpace space(dims.size(), dims.data());
+        space.selectHyperslab(H5S_SELECT_SET, block.data(), start.data());
+        return space;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::readBins(
+        const H5::DataSet &dataSet,
+        bool sumW2,
+        std::size_t nBins,
+        const std::vector<std::size_t> &fileFirst,
+        const std::vector<std::size_t> &first,
+        const std::vector<std::size_t> &count)
+    {
+        H5::DataSpace fileSpace = dataSet.getSpace();
+        if (static_cast<std::size_t>(fileSpace.getSimpleExtentNpoints()) != nBins)
+            throw std::invalid_argument("Dataset '" + dataSet.getObjName() + "' does not match the number of bins");
+        std::vector<hsize_t> start(fileFirst.begin(), fileFirst.end());
+        std::vector<hsize_t> block(count.begin(), count.end());
+        // A histogram without axes is written with a single dimension
+        if (start.empty())
+        {
+            start.push_back(0);
+            block.push_back(1);
+        }
+        if (std::find(block.begin(), block.end(), 0) != block.end())
+            return;
+        fileSpace.selectHyperslab(H5S_SELECT_SET, block.data(), start.data());
+        dataSet.read(m_values.data(), nativeDType<STORAGE>(), storageSpace(sumW2, first, count), fileSpace);
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::makeWeighted()
+    {
+        if (m_weighted)
+            return;
+        std::vector<STORAGE> sumW2(m_values.begin(), m_values.end());
+        interleave(sumW2);
+        m_weighted = true;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::interleave(const std::vector<STORAGE> &sumW2)
+    {
+        std::size_t n = sumW2.size();
+        m_values.resize(2 * n);
+        // Work backwards so that no count is overwritten before it is moved
+        for (std::size_t idx = n; idx-- > 0;)
+        {
+            m_values[2 * idx] = m_values[idx];
+            m_values[2 * idx + 1] = sumW2[idx];
         }
     }
 
     template <typename STORAGE>
-    Histogram<STORAGE> &Histogram<STORAGE>::operator+=(const Histogram &h)
+    Histogram<STORAGE> &Histogram<STORAGE>::add(const Histogram &h, std::size_t nThreads)
     {
         if (nDims() != h.nDims())
             throw std::invalid_argument("Dimensions do not match");
@@ -246,21 +1107,179 @@ namespace H5Histograms
         extensions.reserve(nDims());
         for (std::size_t idx = 0; idx < nDims(); ++idx)
             extensions.push_back(axis(idx).compareAxis(h.axis(idx)));
-        // Now iterate over the bins in the old histogram
-        for (const std::vector<std::size_t> &oldOffsets : h.m_indexer)
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            if (!extensions[idx].fitsInto(axis(idx).fullNBins()))
+                throw std::out_of_range("Bin offset out of range");
+        // Only change this histogram once nothing can throw, as prepareToAdd does
+        if (h.m_weighted)
+            makeWeighted();
+        bool identical = m_weighted == h.m_weighted &&
+            m_base == h.m_base &&
+            m_storage.axisSizes() == h.m_storage.axisSizes() &&
+            std::all_of(extensions.begin(), extensions.end(),
+                [](const IAxis::ExtensionInfo &extension) { return extension.isShift() && extension.shift == 0; });
+        if (identical)
         {
-            std::size_t oldOffset = h.m_indexer.offset_noCheck(oldOffsets);
-            std::vector<std::size_t> newOffsets(nDims());
-            for (std::size_t idx = 0; idx < nDims(); ++idx)
-                newOffsets[idx] = extensions[idx].func(oldOffsets[idx]);
-            std::size_t newOffset = m_indexer.offset_noCheck(newOffsets);
-        
-            m_counts.at(newOffset) += h.m_counts[oldOffset];
-            m_sumW2.at(newOffset) += h.m_sumW2[oldOffset];
+            // Every bin is in the same place in both storages so they can be added in one go
+            addArrays(m_values.data(), h.m_values.data(), m_values.size(), nThreads);
+            markChanged(0, m_storage.nEntries());
+            m_nEntries += h.m_nEntries;
+            return *this;
         }
+        addBins(
+            h.m_indexer.axisSizes(), h.m_storage.strides(), h.m_base, extensions,
+            h.m_values.data(), h.m_weighted ? h.m_values.data() + 1 : nullptr, h.m_weighted ? 2 : 1);
+        m_nEntries += h.m_nEntries;
         return *this;
     }
 
+    template <typename STORAGE>
+    Histogram<STORAGE> &Histogram<STORAGE>::operator+=(const SparseHistogram<STORAGE> &h)
+    {
+        prepareToAdd(h);
+        addPart(h, 0, 1);
+        return *this;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> &Histogram<STORAGE>::operator+=(const WrittenBins &h)
+    {
+        prepareToAdd(h);
+        addPart(h, 0, 1);
+        return *this;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::prepareToAdd(const WrittenBins &h)
+    {
+        if (nDims() != h.axes.size())
+            throw std::invalid_argument("Dimensions do not match");
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            if (!axis(idx).compareAxis(*h.axes[idx]).fitsInto(axis(idx).fullNBins()))
+                throw std::out_of_range("Bin offset out of range");
+        if (h.isWeighted())
+            makeWeighted();
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::prepareToAdd(const SparseHistogram<STORAGE> &h)
+    {
+        compareAxes(h);
+        if (h.isWeighted())
+            makeWeighted();
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::addPart(const WrittenBins &h, std::size_t part, std::size_t nParts)
+    {
+        std::vector<IAxis::ExtensionInfo> extensions;
+        extensions.reserve(nDims());
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            extensions.push_back(axis(idx).compareAxis(*h.axes[idx]));
+        std::visit(
+            [&](auto counts) {
+                using T = std::remove_const_t<std::remove_pointer_t<decltype(counts)>>;
+                addBins(
+                    h.indexer.axisSizes(), h.indexer.strides(), 0, extensions, counts, std::get<const T *>(h.sumW2), 1,
+                    partRows(part, nParts));
+            },
+            h.counts);
+        if (part == 0)
+            m_nEntries += h.nEntries;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::addPart(const SparseHistogram<STORAGE> &h, std::size_t part, std::size_t nParts)
+    {
+        std::vector<IAxis::ExtensionInfo> extensions = compareAxes(h);
+        std::pair<std::size_t, std::size_t> rows = partRows(part, nParts);
+        std::size_t rowSize = storageRowSize();
+        for (std::size_t idx = 0; idx < h.nFilledBins(); ++idx)
+        {
+            std::vector<std::size_t> axisOffsets = h.m_indexer.axisOffsets(h.m_coordinates[idx]);
+            for (std::size_t iAxis = 0; iAxis < nDims(); ++iAxis)
+                axisOffsets[iAxis] = extensions[iAxis].newOffset(axisOffsets[iAxis]);
+            std::size_t offset = storageOffset(axisOffsets);
+            if (offset == SIZE_MAX)
+                throw std::out_of_range("Bin offset out of range");
+            if (offset / rowSize < rows.first || offset / rowSize >= rows.second)
+                continue;
+            markChanged(offset);
+            countAt(offset) += h.m_counts[idx];
+            if (m_weighted)
+                sumW2At(offset) += h.m_sumW2[idx];
+        }
+        if (part == 0)
+            m_nEntries += h.m_nEntries;
+    }
+
+    template <typename STORAGE>
+    std::pair<std::size_t, std::size_t> Histogram<STORAGE>::partRows(std::size_t part, std::size_t nParts) const
+    {
+        std::size_t nRows = m_storage.nEntries() / storageRowSize();
+        return {nRows * part / nParts, nRows * (part + 1) / nParts};
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> Histogram<STORAGE>::slice(const std::vector<bin_range_t> &ranges) const
+    {
+        std::vector<std::size_t> offsets;
+        Histogram h(sliceAxes(m_axes, ranges, offsets), m_values.get_allocator().resource());
+        h.m_nEntries = m_nEntries;
+        if (m_weighted)
+            h.makeWeighted();
+        std::vector<std::size_t> first;
+        std::vector<std::size_t> sizes;
+        std::vector<IAxis::ExtensionInfo> extensions;
+        for (std::size_t idx = 0; idx < ranges.size(); ++idx)
+        {
+            first.push_back(ranges[idx].first);
+            sizes.push_back(ranges[idx].second - ranges[idx].first);
+            extensions.push_back(IAxis::ExtensionInfo::createShift(sizes.back(), offsets[idx]));
+        }
+        h.addBins(
+            sizes, m_storage.strides(), storageOffset(first), extensions,
+            m_values.data(), m_weighted ? m_values.data() + 1 : nullptr, m_weighted ? 2 : 1);
+        return h;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> &Histogram<STORAGE>::merge(const Histogram &h)
+    {
+        if (nDims() != h.nDims())
+            throw std::invalid_argument("Dimensions do not match");
+        std::vector<IAxis::ExtensionInfo> extensions;
+        extensions.reserve(nDims());
+        bool extended = false;
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            std::size_t oldNBins = axis(idx).fullNBins();
+            extensions.push_back(m_axes.at(idx)->mergeAxis(h.axis(idx)));
+            extended |= axis(idx).fullNBins() != oldNBins;
+        }
+        if (extended)
+            resize(extensions);
+        return *this += h;
+    }
+
+    template <typename STORAGE>
+    void Histogram<STORAGE>::copyInto(Histogram &target) const
+    {
+        if (&target == this)
+            return;
+        target.m_axes = cloneAxes();
+        target.m_indexer = m_indexer;
+        target.m_weighted = m_weighted;
+        target.m_nEntries = m_nEntries;
+        target.m_values.assign(m_values.begin(), m_values.end());
+        target.m_storage = m_storage;
+        target.m_origins = m_origins;
+        target.m_base = m_base;
+        target.m_changed = m_changed;
+        target.m_blockShift = m_blockShift;
+        target.m_axesChanged = m_axesChanged;
+    }
+
     // Force the instantiation of the types we defined before
     template class Histogram<int>;
     template class Histogram<int>::Iterator<true>;
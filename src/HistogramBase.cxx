@@ -3,14 +3,38 @@
 #include "H5Composites/BufferReadTraits.h"
 #include "H5Composites/MergeUtils.h"
 #include "H5Histograms/Histogram.h"
+#include "H5Histograms/SparseHistogram.h"
+#include "H5Histograms/MemoryResources.h"
 #include "H5Composites/DTypeDispatch.h"
 
 #include <tuple>
+#include <optional>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <typeinfo>
+#include <variant>
 
 H5COMPOSITES_REGISTER_TYPE_WITH_NAME(H5Histograms::HistogramBase, "H5Histograms::Histogram")
 H5COMPOSITES_REGISTER_MERGE(H5Histograms::HistogramBase)
 
 namespace {
+    bool hasMember(const H5::DataType &dtype, const std::string &name)
+    {
+        H5::CompType compType(dtype.getId());
+        for (int idx = 0; idx < compType.getNmembers(); ++idx)
+            if (compType.getMemberName(idx) == name)
+                return true;
+        return false;
+    }
+
     // Helper struct to break down the data of a histogram
     struct HistogramData
     {
@@ -30,25 +54,307 @@ namespace {
                 );
             }
             countsDType = dtype.getMemberDataType(dtype.getMemberIndex("counts")).getSuper();
-            sumW2DType = dtype.getMemberDataType(dtype.getMemberIndex("sumW2")).getSuper();
+            if (H5Histograms::HistogramBase::storesSumW2(dtype))
+                sumW2DType = dtype.getMemberDataType(dtype.getMemberIndex("sumW2")).getSuper();
         }
         std::vector<std::tuple<H5Composites::TypeRegister::id_t, H5::DataType, const void*>> axes;
         H5::DataType countsDType;
-        H5::DataType sumW2DType;
+        /// Only set for weighted histograms
+        std::optional<H5::DataType> sumW2DType;
     };
 
+    /// Find one of the bin arrays of a written histogram, checking its size
+    std::pair<const void *, H5::DataType> binArray(
+        const void *buffer, const H5::CompType &compType, const std::string &name, std::size_t n)
+    {
+        H5::ArrayType arrayType = compType.getMemberArrayType(compType.getMemberIndex(name));
+        hsize_t size;
+        arrayType.getArrayDims(&size);
+        if (size != n)
+            throw std::invalid_argument("Array '" + name + "' does not match the number of bins");
+        return {H5Composites::getMemberPointer(buffer, compType, name), arrayType.getSuper()};
+    }
+
+    /**
+     * @brief The type to merge bins into
+     *
+     * A sum of many inputs overflows narrow integers, which adaptive histograms in particular are
+     * written with, so integers are merged as 64 bit of the same signedness
+     */
+    H5::PredType widenForMerge(const H5::PredType &dtype)
+    {
+        if (dtype.getClass() != H5T_INTEGER || dtype.getSize() >= 8)
+            return dtype;
+        return H5Tget_sign(dtype.getId()) == H5T_SGN_NONE ? H5::PredType::NATIVE_UINT64 : H5::PredType::NATIVE_INT64;
+    }
+
+    /// The limits set by HistogramBase::setMergeLimits, 0 threads means one per core
+    std::atomic<std::size_t> mergeThreads{0};
+    std::atomic<std::size_t> mergeInFlight{H5Histograms::HistogramBase::defaultMergeInFlight};
+
+    std::size_t nMergeThreads()
+    {
+        std::size_t n = mergeThreads.load();
+        return n == 0 ? std::max<unsigned int>(std::thread::hardware_concurrency(), 1) : n;
+    }
+
+    /// Point to bins of the first of the types whose native type matches dtype
+    template <typename T, typename... TS>
+    bool pointToNativeBins(
+        const H5::DataType &dtype,
+        const void *counts,
+        const void *sumW2,
+        H5Histograms::HistogramBase::bins_ptr_t &countsOut,
+        H5Histograms::HistogramBase::bins_ptr_t &sumW2Out)
+    {
+        if (dtype == H5Histograms::HistogramBase::nativeDType<T>())
+        {
+            // Reading misaligned bins in place is undefined, leave those to be converted
+            if (reinterpret_cast<std::uintptr_t>(counts) % alignof(T) != 0 ||
+                reinterpret_cast<std::uintptr_t>(sumW2) % alignof(T) != 0)
+                return false;
+            countsOut = static_cast<const T *>(counts);
+            sumW2Out = static_cast<const T *>(sumW2);
+            return true;
+        }
+        if constexpr (sizeof...(TS) > 0)
+            return pointToNativeBins<TS...>(dtype, counts, sumW2, countsOut, sumW2Out);
+        else
+            return false;
+    }
+
     template <typename T>
     struct HistogramBuilder
     {
         H5Composites::H5Buffer operator()(
             std::vector<std::unique_ptr<H5Histograms::IAxis>> &&axes,
-            const std::vector<std::pair<H5::DataType, const void*>> &buffers)
+            const std::vector<std::pair<H5::DataType, const void*>> &buffers,
+            bool sparse)
         {
-            H5Histograms::Histogram<T> h(std::move(axes));
-            for (const std::pair<H5::DataType, const void *> &buffer : buffers)
-                h += H5Composites::fromBuffer<H5Histograms::Histogram<T>>(buffer.second, buffer.first);
+            if (sparse)
+                return merge(H5Histograms::SparseHistogram<T>(std::move(axes)), buffers);
+            else
+                return merge(H5Histograms::Histogram<T>(std::move(axes), H5Histograms::hugePageResource()), buffers);
+        }
+
+        /// Dense inputs are added straight from their buffers
+        using input_t = std::variant<H5Histograms::HistogramBase::WrittenBins, H5Histograms::SparseHistogram<T>>;
+
+        /**
+         * Every worker adds its own part of every input to the one output histogram, see
+         * Histogram::addPart, so the memory used does not grow with the number of threads
+         */
+        H5Composites::H5Buffer merge(
+            H5Histograms::Histogram<T> &&h, const std::vector<std::pair<H5::DataType, const void*>> &buffers)
+        {
+            std::size_t nWorkers = std::min<std::size_t>(nMergeThreads(), buffers.size());
+            if (nWorkers <= 1)
+            {
+                for (const std::pair<H5::DataType, const void *> &buffer : buffers)
+                    std::visit([&h] (const auto &input) { h += input; }, read(buffer.first, buffer.second));
+                return H5Composites::toBuffer(h);
+            }
+            std::size_t nInFlight = std::max<std::size_t>(mergeInFlight.load(), 1);
+            // Reading the inputs calls HDF5, which is not re-entrant, so it happens on this thread.
+            // Each input stays in the queue until every worker has added its part of it.
+            struct Pending
+            {
+                input_t input;
+                std::size_t nRemaining;
+            };
+            std::mutex mutex;
+            std::condition_variable changed;
+            // Elements of a deque are not moved when others are added or removed at the ends
+            std::deque<Pending> queue;
+            // The position in the inputs of the front of the queue
+            std::size_t nRemoved = 0;
+            bool finished = false;
+            std::exception_ptr error;
+            std::vector<std::thread> workers;
+            workers.reserve(nWorkers);
+            for (std::size_t part = 0; part < nWorkers; ++part)
+                workers.emplace_back([&, part] () {
+                    for (std::size_t next = 0; ; ++next)
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&] { return next < nRemoved + queue.size() || finished || error; });
+                        if (error || next >= nRemoved + queue.size())
+                            return;
+                        Pending &pending = queue[next - nRemoved];
+                        lock.unlock();
+                        try
+                        {
+                            std::visit([&] (const auto &input) { h.addPart(input, part, nWorkers); }, pending.input);
+                        }
+                        catch (...)
+                        {
+                            lock.lock();
+                            if (!error)
+                                error = std::current_exception();
+                            changed.notify_all();
+                            return;
+                        }
+                        lock.lock();
+                        if (--pending.nRemaining == 0)
+                            while (!queue.empty() && queue.front().nRemaining == 0)
+                            {
+                                queue.pop_front();
+                                ++nRemoved;
+                            }
+                        changed.notify_all();
+                    }
+                });
+            try
+            {
+                for (const std::pair<H5::DataType, const void *> &buffer : buffers)
+                {
+                    input_t input = read(buffer.first, buffer.second);
+                    bool weighted = std::visit([] (const auto &histogram) { return histogram.isWeighted(); }, input);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    // Starting to store the sumW2 moves every bin, so wait for the workers to finish first
+                    std::size_t maxQueued = weighted && !h.isWeighted() ? 0 : nInFlight - 1;
+                    changed.wait(lock, [&] { return queue.size() <= maxQueued || error; });
+                    if (error)
+                        break;
+                    std::visit([&h] (const auto &histogram) { h.prepareToAdd(histogram); }, input);
+                    queue.push_back({std::move(input), nWorkers});
+                    lock.unlock();
+                    changed.notify_all();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished = true;
+            }
+            changed.notify_all();
+            for (std::thread &worker : workers)
+                worker.join();
+            if (error)
+                std::rethrow_exception(error);
             return H5Composites::toBuffer(h);
         }
+
+        /// Sparse outputs cannot be shared between threads so each worker keeps a partial sum
+        H5Composites::H5Buffer merge(
+            H5Histograms::SparseHistogram<T> &&h, const std::vector<std::pair<H5::DataType, const void*>> &buffers)
+        {
+            using HISTOGRAM = H5Histograms::SparseHistogram<T>;
+            std::size_t nWorkers = std::min<std::size_t>(nMergeThreads(), buffers.size());
+            std::size_t nInFlight = std::max<std::size_t>(mergeInFlight.load(), 1);
+            if (nWorkers <= 1)
+            {
+                for (const std::pair<H5::DataType, const void *> &buffer : buffers)
+                    std::visit([&h] (const auto &input) { add(h, input); }, read(buffer.first, buffer.second));
+                return H5Composites::toBuffer(h);
+            }
+            // Every worker adds the inputs it takes into its own partial sum
+            std::vector<HISTOGRAM> partials;
+            partials.reserve(nWorkers);
+            for (std::size_t idx = 1; idx < nWorkers; ++idx)
+                partials.emplace_back(h.cloneAxes());
+            partials.push_back(std::move(h));
+            // Reading the inputs calls HDF5, which is not re-entrant, so it happens on this thread.
+            std::mutex mutex;
+            std::condition_variable notFull;
+            std::condition_variable notEmpty;
+            std::deque<input_t> queue;
+            bool finished = false;
+            std::exception_ptr error;
+            std::vector<std::thread> workers;
+            workers.reserve(nWorkers);
+            for (HISTOGRAM &partial : partials)
+                workers.emplace_back([&, partial = &partial] () {
+                    while (true)
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        notEmpty.wait(lock, [&] { return !queue.empty() || finished || error; });
+                        if (error || queue.empty())
+                            return;
+                        input_t input = std::move(queue.front());
+                        queue.pop_front();
+                        lock.unlock();
+                        notFull.notify_one();
+                        try
+                        {
+                            std::visit([partial] (const auto &histogram) { add(*partial, histogram); }, input);
+                        }
+                        catch (...)
+                        {
+                            lock.lock();
+                            if (!error)
+                                error = std::current_exception();
+                            notFull.notify_all();
+                            notEmpty.notify_all();
+                            return;
+                        }
+                    }
+                });
+            try
+            {
+                for (const std::pair<H5::DataType, const void *> &buffer : buffers)
+                {
+                    input_t input = read(buffer.first, buffer.second);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    notFull.wait(lock, [&] { return queue.size() < nInFlight || error; });
+                    if (error)
+                        break;
+                    queue.push_back(std::move(input));
+                    lock.unlock();
+                    notEmpty.notify_one();
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished = true;
+            }
+            notEmpty.notify_all();
+            for (std::thread &worker : workers)
+                worker.join();
+            if (error)
+                std::rethrow_exception(error);
+            // Combine the partial sums in pairs, each level in parallel
+            for (std::size_t step = 1; step < partials.size(); step *= 2)
+            {
+                std::vector<std::thread> threads;
+                for (std::size_t idx = 0; idx + step < partials.size(); idx += 2 * step)
+                    threads.emplace_back([&partials, idx, step] () { partials[idx] += partials[idx + step]; });
+                for (std::thread &thread : threads)
+                    thread.join();
+            }
+            return H5Composites::toBuffer(partials.front());
+        }
+
+        /// Read an input histogram, dense inputs are not copied out of their buffers
+        static input_t read(const H5::DataType &dtype, const void *buffer)
+        {
+            if (H5Histograms::HistogramBase::isSparse(dtype))
+                return input_t(
+                    std::in_place_index<1>,
+                    H5Composites::fromBuffer<H5Histograms::SparseHistogram<T>>(buffer, dtype));
+            return input_t(std::in_place_index<0>, buffer, dtype);
+        }
+
+        static void add(H5Histograms::SparseHistogram<T> &, const H5Histograms::HistogramBase::WrittenBins &)
+        {
+            throw std::logic_error("Sparse merges only have sparse inputs");
+        }
+
+        static void add(H5Histograms::SparseHistogram<T> &h, const H5Histograms::SparseHistogram<T> &input)
+        {
+            h += input;
+        }
     };
 }
 
@@ -61,14 +367,53 @@ namespace H5Histograms
         calculateStrides();
     }
 
+    HistogramBase::WrittenBins::WrittenBins(const void *buffer, const H5::DataType &dtype)
+        : indexer({})
+    {
+        if (isSparse(dtype))
+            throw std::invalid_argument("Data type describes a sparse histogram");
+        H5::CompType compType(dtype.getId());
+        HistogramData data(compType, buffer);
+        std::vector<std::size_t> sizes;
+        sizes.reserve(data.axes.size());
+        axes.reserve(data.axes.size());
+        for (const auto &[typeID, axisDType, axisData] : data.axes)
+        {
+            axes.push_back(IAxisFactory::instance().create(typeID, axisData, axisDType));
+            sizes.push_back(axes.back()->fullNBins());
+        }
+        indexer = sizes;
+        nEntries = H5Composites::readCompositeElement<std::size_t>(buffer, compType, "nEntries");
+        std::size_t n = indexer.nEntries();
+        bool weighted = data.sumW2DType.has_value();
+        std::pair<const void *, H5::DataType> countsArray = binArray(buffer, compType, "counts", n);
+        const void *sumW2Data = weighted ? binArray(buffer, compType, "sumW2", n).first : nullptr;
+        if ((!weighted || *data.sumW2DType == countsArray.second) &&
+            pointToNativeBins<
+                int, unsigned int, char, signed char, unsigned char, short, unsigned short,
+                long, long long, unsigned long, unsigned long long, float, double>(
+                countsArray.second, countsArray.first, sumW2Data, counts, sumW2))
+            return;
+        // Fall back to converting the bins
+        converted.resize(weighted ? 2 * n : n);
+        readBinArray(buffer, dtype, "counts", H5::PredType::NATIVE_DOUBLE, converted.data(), n);
+        if (weighted)
+            readBinArray(buffer, dtype, "sumW2", H5::PredType::NATIVE_DOUBLE, converted.data() + n, n);
+        counts = static_cast<const double *>(converted.data());
+        sumW2 = static_cast<const double *>(weighted ? converted.data() + n : nullptr);
+    }
+
     H5Composites::H5Buffer HistogramBase::mergeBuffers(const std::vector<std::pair<H5::DataType, const void *>> &buffers)
     {
         std::optional<std::size_t> nDims;
         std::vector<std::optional<H5Composites::TypeRegister::id_t>> axisTypeIDs;
         std::vector<std::vector<std::pair<H5::DataType, const void *>>> axisData;
         std::vector<H5::DataType> countDTypes;
+        // The result is only sparse if all of the inputs are
+        bool sparse = true;
         for (const std::pair<H5::DataType, const void *> &buffer : buffers)
         {
+            sparse &= isSparse(buffer.first);
             HistogramData data(buffer.first.getId(), buffer.second);
             if (!nDims.has_value())
             {
@@ -84,7 +429,8 @@ namespace H5Histograms
                 axisData.at(idx).emplace_back(std::get<1>(data.axes.at(idx)), std::get<2>(data.axes.at(idx)));
             }
             countDTypes.push_back(data.countsDType);
-            countDTypes.push_back(data.sumW2DType);
+            if (data.sumW2DType)
+                countDTypes.push_back(*data.sumW2DType);
         }
         // Now get the merged axes
         std::vector<std::unique_ptr<IAxis>> axes;
@@ -95,8 +441,26 @@ namespace H5Histograms
             axes.push_back(IAxisFactory::instance().create(*axisTypeIDs.at(idx), merged));
         }
         // Get a common data type
-        H5::PredType common = H5Composites::getCommonNumericDType(countDTypes);
-        return H5Composites::apply_if<std::is_arithmetic, HistogramBuilder>(common, std::move(axes), buffers);
+        H5::PredType common = widenForMerge(H5Composites::getCommonNumericDType(countDTypes));
+        return H5Composites::apply_if<std::is_arithmetic, HistogramBuilder>(common, std::move(axes), buffers, sparse);
+    }
+
+    void HistogramBase::setMergeLimits(std::size_t nThreads, std::size_t nInFlight)
+    {
+        if (nInFlight == 0)
+            throw std::invalid_argument("At least one input must be in flight");
+        mergeThreads = nThreads;
+        mergeInFlight = nInFlight;
+    }
+
+    bool HistogramBase::storesSumW2(const H5::DataType &dtype)
+    {
+        return hasMember(dtype, "sumW2");
+    }
+
+    bool HistogramBase::isSparse(const H5::DataType &dtype)
+    {
+        return hasMember(dtype, "coordinates");
     }
 
     std::size_t HistogramBase::nDims() const
@@ -109,6 +473,15 @@ namespace H5Histograms
         return *m_axes.at(idx);
     }
 
+    std::vector<std::unique_ptr<IAxis>> HistogramBase::cloneAxes() const
+    {
+        std::vector<std::unique_ptr<IAxis>> axes;
+        axes.reserve(nDims());
+        for (const std::unique_ptr<IAxis> &axis : m_axes)
+            axes.push_back(axis->clone());
+        return axes;
+    }
+
     std::vector<IAxis::index_t> HistogramBase::findBin(const value_t &values) const
     {
         if (nDims() != values.size())
@@ -150,11 +523,99 @@ namespace H5Histograms
         return m_indexer.offset_noCheck(axisOffsetsFromIndices(indices));
     }
 
+    std::size_t HistogramBase::binOffsetFromValues(const IAxis::value_view_t *values, std::size_t nValues) const
+    {
+        return binOffsetFromValues(values, nValues, m_indexer.strides());
+    }
+
+    std::size_t HistogramBase::binOffsetFromValues(
+        const IAxis::value_view_t *values,
+        std::size_t nValues,
+        const std::vector<std::size_t> &strides) const
+    {
+        if (nDims() != nValues)
+            throw std::invalid_argument("Incorrect number of values provided");
+        std::size_t offset = 0;
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            std::size_t axisOffset = m_axes[idx]->binOffsetFromView(values[idx]);
+            if (axisOffset == SIZE_MAX)
+                return SIZE_MAX;
+            offset += axisOffset * strides[idx];
+        }
+        return offset;
+    }
+
+    void HistogramBase::binOffsetsFromColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t first,
+        std::size_t n,
+        std::size_t *offsets,
+        std::size_t *scratch) const
+    {
+        binOffsetsFromColumns(columns, first, n, offsets, scratch, m_indexer.strides());
+    }
+
+    void HistogramBase::binOffsetsFromColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t first,
+        std::size_t n,
+        std::size_t *offsets,
+        std::size_t *scratch,
+        const std::vector<std::size_t> &strides) const
+    {
+        if (nDims() != columns.size())
+            throw std::invalid_argument("Incorrect number of columns provided");
+        std::fill(offsets, offsets + n, 0);
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            m_axes[idx]->binOffsetsFromColumn(columns[idx], first, n, scratch);
+            std::size_t stride = strides[idx];
+            for (std::size_t iEvent = 0; iEvent < n; ++iEvent)
+                offsets[iEvent] = (offsets[iEvent] == SIZE_MAX || scratch[iEvent] == SIZE_MAX)
+                    ? SIZE_MAX
+                    : offsets[iEvent] + scratch[iEvent] * stride;
+        }
+    }
+
     bool HistogramBase::contains(const value_t &values) const
     {
         return binOffsetFromValues(values) != SIZE_MAX;
     }
 
+    std::vector<HistogramBase::bin_range_t> HistogramBase::binRanges(
+        const std::vector<std::pair<IAxis::value_t, IAxis::value_t>> &box) const
+    {
+        if (nDims() != box.size())
+            throw std::invalid_argument("Incorrect number of value ranges provided");
+        std::vector<bin_range_t> ranges;
+        ranges.reserve(nDims());
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+        {
+            std::size_t first = axis(idx).binOffsetFromValue(box[idx].first);
+            std::size_t last = axis(idx).binOffsetFromValue(box[idx].second);
+            if (first == SIZE_MAX || last == SIZE_MAX)
+                throw std::out_of_range("Value range outside of axis '" + axis(idx).label() + "'");
+            if (last < first)
+                throw std::invalid_argument("Value range on axis '" + axis(idx).label() + "' is reversed");
+            ranges.emplace_back(first, last + 1);
+        }
+        return ranges;
+    }
+
+    std::string HistogramBase::dtypeKey() const
+    {
+        std::string key = typeid(*this).name();
+        for (const std::unique_ptr<IAxis> &axis : m_axes)
+            key += "|" + axis->dtypeKey();
+        return key + "|" + std::to_string(fullNBins());
+    }
+
+    void HistogramBase::writeBufferWithDType(void *buffer, const H5::DataType &) const
+    {
+        writeBuffer(buffer);
+    }
+
     std::size_t HistogramBase::nBins() const
     {
         std::size_t n = 1;
@@ -168,6 +629,34 @@ namespace H5Histograms
         return m_indexer.nEntries();
     }
 
+    HistogramBase::value_t HistogramBase::ownedValues(const IAxis::value_view_t *values, std::size_t nValues) const
+    {
+        if (nDims() != nValues)
+            throw std::invalid_argument("Incorrect number of values provided");
+        value_t owned;
+        owned.reserve(nValues);
+        for (std::size_t idx = 0; idx < nValues; ++idx)
+            owned.push_back(axis(idx).ownedValue(values[idx]));
+        return owned;
+    }
+
+    HistogramBase::value_t HistogramBase::valuesFromColumns(const std::vector<IAxis::column_t> &columns, std::size_t idx) const
+    {
+        value_t values;
+        values.reserve(columns.size());
+        for (std::size_t iAxis = 0; iAxis < columns.size(); ++iAxis)
+        {
+            const IAxis::column_t &column = columns[iAxis];
+            if (const double *const *numbers = std::get_if<const double *>(&column))
+                values.emplace_back((*numbers)[idx]);
+            else if (const IAxis::CategoryToken *const *tokens = std::get_if<const IAxis::CategoryToken *>(&column))
+                values.push_back(axis(iAxis).ownedValue((*tokens)[idx]));
+            else
+                values.emplace_back(std::get<const std::string *>(column)[idx]);
+        }
+        return values;
+    }
+
     void HistogramBase::calculateStrides()
     {
         std::vector<std::size_t> sizes(nDims(), 0);
@@ -178,16 +667,116 @@ namespace H5Histograms
 
     std::vector<IAxis::ExtensionInfo> HistogramBase::extendAxes(const value_t &values, std::size_t &offset)
     {
+        if (nDims() != values.size())
+            throw std::invalid_argument("Incorrect number of values provided");
         std::vector<IAxis::ExtensionInfo> ret;
         ret.reserve(nDims());
         std::vector<std::size_t> offsets(nDims(), 0);
+        std::vector<std::size_t> sizes(nDims(), 0);
         for (std::size_t idx = 0; idx < nDims(); ++idx)
         {
-            std::size_t axisOffset = 0;
-            ret.push_back(m_axes.at(idx)->extendAxis(values.at(idx), axisOffset));
-            offsets.push_back(axisOffset);
+            ret.push_back(m_axes.at(idx)->extendAxis(values.at(idx), offsets[idx]));
+            sizes[idx] = axis(idx).fullNBins();
+        }
+        // The indexer is only updated once the storage is resized so the offset has to be
+        // calculated using the new axis sizes
+        offset = ArrayIndexer(sizes).offset_noCheck(offsets);
+        return ret;
+    }
+
+    std::vector<IAxis::ExtensionInfo> HistogramBase::extendAxis(std::size_t idx, const IAxis::value_t &value)
+    {
+        std::vector<IAxis::ExtensionInfo> ret;
+        ret.reserve(nDims());
+        for (std::size_t iAxis = 0; iAxis < nDims(); ++iAxis)
+        {
+            if (iAxis == idx)
+            {
+                std::size_t axisOffset;
+                ret.push_back(m_axes.at(iAxis)->extendAxis(value, axisOffset));
+            }
+            else
+                ret.push_back(IAxis::ExtensionInfo::createIdentity(axis(iAxis).fullNBins()));
         }
-        offset = m_indexer.offset_noCheck(offsets);
         return ret;
     }
+
+    std::vector<IAxis::ExtensionInfo> HistogramBase::compareAxes(const HistogramBase &other) const
+    {
+        if (nDims() != other.nDims())
+            throw std::invalid_argument("Dimensions do not match");
+        std::vector<IAxis::ExtensionInfo> extensions;
+        extensions.reserve(nDims());
+        for (std::size_t idx = 0; idx < nDims(); ++idx)
+            extensions.push_back(axis(idx).compareAxis(other.axis(idx)));
+        return extensions;
+    }
+
+    std::vector<std::unique_ptr<IAxis>> HistogramBase::sliceAxes(
+        const std::vector<std::unique_ptr<IAxis>> &axes,
+        const std::vector<bin_range_t> &ranges,
+        std::vector<std::size_t> &offsets)
+    {
+        if (axes.size() != ranges.size())
+            throw std::invalid_argument("Incorrect number of bin ranges provided");
+        std::vector<std::unique_ptr<IAxis>> sliced;
+        sliced.reserve(axes.size());
+        offsets.assign(axes.size(), 0);
+        for (std::size_t idx = 0; idx < axes.size(); ++idx)
+            sliced.push_back(axes[idx]->slice(ranges[idx].first, ranges[idx].second, offsets[idx]));
+        return sliced;
+    }
+
+    std::size_t HistogramBase::mapOffset(
+        std::size_t offset,
+        const ArrayIndexer &from,
+        const ArrayIndexer &to,
+        const std::vector<IAxis::ExtensionInfo> &extensions)
+    {
+        std::vector<std::size_t> offsets = from.axisOffsets(offset);
+        for (std::size_t idx = 0; idx < offsets.size(); ++idx)
+            offsets[idx] = extensions[idx].newOffset(offsets[idx]);
+        return to.offset_noCheck(offsets);
+    }
+
+    H5::CompType HistogramBase::appendBinArrays(
+        const H5::DataType &header, const H5::DataType &element, bool weighted) const
+    {
+        H5::CompType headerType(header.getId());
+        hsize_t n = fullNBins();
+        H5::ArrayType arrayType(element, 1, &n);
+        // Pad the header so that the bins can be read in place from an aligned buffer. The
+        // elements are native arithmetic types, aligned to their size on the platforms we support
+        std::size_t align = std::min(element.getSize(), alignof(std::max_align_t));
+        std::size_t countsOffset = (headerType.getSize() + align - 1) / align * align;
+        H5::CompType dtype(countsOffset + (weighted ? 2 : 1) * arrayType.getSize());
+        for (int idx = 0; idx < headerType.getNmembers(); ++idx)
+            dtype.insertMember(
+                headerType.getMemberName(idx), headerType.getMemberOffset(idx), headerType.getMemberDataType(idx));
+        dtype.insertMember("counts", countsOffset, arrayType);
+        if (weighted)
+            dtype.insertMember("sumW2", countsOffset + arrayType.getSize(), arrayType);
+        return dtype;
+    }
+
+    void HistogramBase::readBinArray(
+        const void *buffer,
+        const H5::DataType &dtype,
+        const std::string &name,
+        const H5::DataType &memType,
+        void *out,
+        std::size_t n)
+    {
+        auto [data, super] = binArray(buffer, H5::CompType(dtype.getId()), name, n);
+        if (super == memType)
+        {
+            std::memcpy(out, data, n * memType.getSize());
+            return;
+        }
+        // Conversion happens in place so needs space for the larger of the two types
+        std::vector<char> converted(n * std::max(super.getSize(), memType.getSize()));
+        std::memcpy(converted.data(), data, n * super.getSize());
+        super.convert(memType, n, converted.data(), nullptr);
+        std::memcpy(out, converted.data(), n * memType.getSize());
+    }
 }
\ No newline at end of file
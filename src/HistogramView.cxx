@@ -0,0 +1,88 @@
+#include "H5Histograms/HistogramView.h"
+
+#include <cstring>
+
+namespace H5Histograms
+{
+    HistogramBase::index_t HistogramView::const_iterator::indices() const
+    {
+        std::vector<std::size_t> offsets = m_view.m_indexer.axisOffsets(m_offset);
+        HistogramBase::index_t ret(offsets.size());
+        for (std::size_t idx = 0; idx < offsets.size(); ++idx)
+            ret[idx] = m_view.axis(idx).indexFromBinOffset(offsets[idx]);
+        return ret;
+    }
+
+    HistogramView::HistogramView(const void *buffer, const H5::DataType &dtype)
+        : HistogramView(WrittenBins(buffer, dtype), buffer, dtype)
+    {}
+
+    HistogramView::HistogramView(const H5Composites::H5Buffer &buffer)
+        : HistogramView(buffer.get(), buffer.dtype())
+    {}
+
+    HistogramView::HistogramView(WrittenBins &&bins, const void *buffer, const H5::DataType &dtype)
+        : HistogramBase(std::move(bins.axes)),
+          m_buffer(buffer),
+          m_dtype(dtype),
+          m_nEntries(bins.nEntries),
+          m_weighted(std::visit([](auto sumW2) { return sumW2 != nullptr; }, bins.sumW2)),
+          m_counts(bins.counts),
+          m_sumW2(bins.sumW2),
+          m_converted(std::move(bins.converted))
+    {}
+
+    H5::DataType HistogramView::h5DType() const
+    {
+        return m_dtype;
+    }
+
+    void HistogramView::writeBuffer(void *buffer) const
+    {
+        std::memcpy(buffer, m_buffer, m_dtype.getSize());
+    }
+
+    std::string HistogramView::dtypeKey() const
+    {
+        // Views keep the data type they were written with, which may not be native
+        return HistogramBase::dtypeKey() + "|" + std::to_string(m_dtype.getSize()) + "|" +
+               std::to_string(m_counts.index()) + (m_weighted ? "|w" : "|u");
+    }
+
+    void HistogramView::writeBufferWithDType(void *buffer, const H5::DataType &dtype) const
+    {
+        if (dtype != m_dtype)
+            throw std::invalid_argument("Views can only be written with their own data type");
+        writeBuffer(buffer);
+    }
+
+    double HistogramView::contents(const index_t &indices) const
+    {
+        return countAt(checkedOffset(indices));
+    }
+
+    double HistogramView::sumW2(const index_t &indices) const
+    {
+        return sumW2At(checkedOffset(indices));
+    }
+
+    std::size_t HistogramView::checkedOffset(const index_t &indices) const
+    {
+        std::size_t offset = m_indexer.offset(axisOffsetsFromIndices(indices));
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        return offset;
+    }
+
+    double HistogramView::countAt(std::size_t offset) const
+    {
+        return std::visit([offset](auto counts) { return static_cast<double>(counts[offset]); }, m_counts);
+    }
+
+    double HistogramView::sumW2At(std::size_t offset) const
+    {
+        return m_weighted
+            ? std::visit([offset](auto sumW2) { return static_cast<double>(sumW2[offset]); }, m_sumW2)
+            : countAt(offset);
+    }
+} //> end namespace H5Histograms
@@ -0,0 +1,178 @@
+#include "H5Histograms/HistogramWriter.h"
+#include "H5Histograms/ChunkedLayout.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    /// A row of the index dataset
+    struct IndexRow
+    {
+        const char *name;
+        unsigned int batch;
+        hsize_t row;
+    };
+
+    const H5::CompType &indexDType()
+    {
+        static H5::CompType dtype = [] {
+            H5::CompType dtype(sizeof(IndexRow));
+            dtype.insertMember("name", HOFFSET(IndexRow, name), H5::StrType(H5::PredType::C_S1, H5T_VARIABLE));
+            dtype.insertMember("batch", HOFFSET(IndexRow, batch), H5::PredType::NATIVE_UINT);
+            dtype.insertMember("row", HOFFSET(IndexRow, row), H5::PredType::NATIVE_HSIZE);
+            return dtype;
+        }();
+        return dtype;
+    }
+} // namespace
+
+namespace H5Histograms
+{
+    const std::string HistogramWriter::indexName = "index";
+    const std::string HistogramWriter::batchPrefix = "batch";
+
+    HistogramWriter::HistogramWriter(const H5::Group &location, std::size_t bufferBytes)
+        // Reopen the location so that files are held as their root group rather than sliced
+        : m_location(location.openGroup(".")), m_bufferBytes(bufferBytes)
+    {
+        if (m_location.nameExists(indexName))
+            throw std::invalid_argument("Location already holds histograms from another writer");
+    }
+
+    HistogramWriter::~HistogramWriter()
+    {
+        try
+        {
+            flush();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    void HistogramWriter::write(const std::string &name, const HistogramBase &histogram)
+    {
+        if (m_names.count(name))
+            throw std::invalid_argument("A histogram called " + name + " was already written");
+        std::string key = histogram.dtypeKey();
+        auto itr = m_batchIndices.find(key);
+        if (itr == m_batchIndices.end())
+        {
+            Batch batch;
+            batch.dtype = histogram.h5DType();
+            batch.size = batch.dtype.getSize();
+            batch.name = batchPrefix + std::to_string(m_batches.size());
+            itr = m_batchIndices.emplace(std::move(key), m_batches.size()).first;
+            m_batches.push_back(std::move(batch));
+        }
+        Batch &batch = m_batches[itr->second];
+        std::size_t nPending = batch.pending.size() / batch.size;
+        batch.pending.resize(batch.pending.size() + batch.size);
+        histogram.writeBufferWithDType(batch.pending.data() + nPending * batch.size, batch.dtype);
+        m_names.insert(name);
+        m_pendingNames.push_back(name);
+        m_pendingBatches.push_back(itr->second);
+        m_pendingRows.push_back(batch.nWritten + nPending);
+        m_pendingBytes += batch.size;
+        if (m_pendingBytes >= m_bufferBytes)
+            flush();
+    }
+
+    void HistogramWriter::flush()
+    {
+        for (Batch &batch : m_batches)
+        {
+            if (batch.pending.empty())
+                continue;
+            hsize_t n = batch.pending.size() / batch.size;
+            append(m_location, batch.dataSet, batch.name, batch.dtype, batch.nWritten, n, batch.pending.data());
+            batch.nWritten += n;
+            batch.pending.clear();
+        }
+        if (!m_pendingNames.empty())
+        {
+            std::vector<IndexRow> rows;
+            rows.reserve(m_pendingNames.size());
+            for (std::size_t idx = 0; idx < m_pendingNames.size(); ++idx)
+                rows.push_back({m_pendingNames[idx].c_str(), m_pendingBatches[idx], m_pendingRows[idx]});
+            append(m_location, m_index, indexName, indexDType(), m_nIndexed, rows.size(), rows.data());
+            m_nIndexed += rows.size();
+            m_pendingNames.clear();
+            m_pendingBatches.clear();
+            m_pendingRows.clear();
+        }
+        m_pendingBytes = 0;
+    }
+
+    std::vector<char> HistogramWriter::readBuffer(const H5::Group &location, const std::string &name, H5::DataType &dtype)
+    {
+        H5::DataSet index = location.openDataSet(indexName);
+        H5::DataSpace indexSpace = index.getSpace();
+        std::vector<IndexRow> rows(indexSpace.getSimpleExtentNpoints());
+        index.read(rows.data(), indexDType());
+        auto itr = std::find_if(rows.begin(), rows.end(), [&name](const IndexRow &row) { return name == row.name; });
+        bool found = itr != rows.end();
+        unsigned int batch = found ? itr->batch : 0;
+        hsize_t row = found ? itr->row : 0;
+        H5::DataSet::vlenReclaim(rows.data(), indexDType(), indexSpace);
+        if (!found)
+            throw std::out_of_range("No histogram called " + name);
+        return readRow(location, batch, row, dtype);
+    }
+
+    HistogramWriter::index_t HistogramWriter::readIndex(const H5::Group &location)
+    {
+        H5::DataSet index = location.openDataSet(indexName);
+        H5::DataSpace indexSpace = index.getSpace();
+        std::vector<IndexRow> rows(indexSpace.getSimpleExtentNpoints());
+        index.read(rows.data(), indexDType());
+        index_t result;
+        result.reserve(rows.size());
+        for (const IndexRow &row : rows)
+            result.emplace(row.name, std::make_pair(row.batch, row.row));
+        H5::DataSet::vlenReclaim(rows.data(), indexDType(), indexSpace);
+        return result;
+    }
+
+    std::vector<char> HistogramWriter::readBuffer(
+        const H5::Group &location, const index_t &index, const std::string &name, H5::DataType &dtype)
+    {
+        auto itr = index.find(name);
+        if (itr == index.end())
+            throw std::out_of_range("No histogram called " + name);
+        return readRow(location, itr->second.first, itr->second.second, dtype);
+    }
+
+    std::vector<char> HistogramWriter::readRow(
+        const H5::Group &location, unsigned int batch, hsize_t row, H5::DataType &dtype)
+    {
+        H5::DataSet dataSet = location.openDataSet(batchPrefix + std::to_string(batch));
+        dtype = dataSet.getDataType();
+        H5::DataSpace fileSpace = dataSet.getSpace();
+        hsize_t count = 1;
+        fileSpace.selectHyperslab(H5S_SELECT_SET, &count, &row);
+        std::vector<char> buffer(dtype.getSize());
+        dataSet.read(buffer.data(), dtype, H5::DataSpace(1, &count), fileSpace);
+        return buffer;
+    }
+
+    void HistogramWriter::append(
+        const H5::Group &location, std::optional<H5::DataSet> &dataSet, const std::string &name,
+        const H5::DataType &dtype, hsize_t nWritten, hsize_t n, const void *buffer)
+    {
+        if (!dataSet)
+        {
+            hsize_t dim = 0;
+            hsize_t maxDim = H5S_UNLIMITED;
+            hsize_t chunk = std::max<hsize_t>(ChunkedLayout::defaultChunkBytes / dtype.getSize(), 1);
+            H5::DSetCreatPropList propList;
+            propList.setChunk(1, &chunk);
+            dataSet = location.createDataSet(name, dtype, H5::DataSpace(1, &dim, &maxDim), propList);
+        }
+        hsize_t size = nWritten + n;
+        dataSet->extend(&size);
+        H5::DataSpace fileSpace = dataSet->getSpace();
+        fileSpace.selectHyperslab(H5S_SELECT_SET, &n, &nWritten);
+        dataSet->write(buffer, dtype, H5::DataSpace(1, &n), fileSpace);
+    }
+} //> end namespace H5Histograms
@@ -1,6 +1,9 @@
 #include "H5Histograms/IAxis.h"
 #include "H5Composites/CompDTypeUtils.h"
 
+#include <algorithm>
+#include <stdexcept>
+
 namespace H5Composites
 {
     H5::DataType H5DType<std::unique_ptr<H5Histograms::IAxis>>::getType(const std::unique_ptr<H5Histograms::IAxis> &value)
@@ -38,24 +41,89 @@ namespace H5Composites
 
 namespace H5Histograms
 {
+    bool IAxis::ExtensionInfo::fitsInto(std::size_t newNBins) const
+    {
+        if (isShift())
+            return oldNBins + shift <= newNBins;
+        return std::all_of(table.begin(), table.end(), [newNBins](std::size_t offset) { return offset < newNBins; });
+    }
+
     IAxis::ExtensionInfo IAxis::ExtensionInfo::createIdentity(std::size_t oldNBins)
     {
-        return ExtensionInfo{[] (std::size_t idx) { return idx; }, oldNBins};
+        return ExtensionInfo{oldNBins, 0, {}};
     }
 
     IAxis::ExtensionInfo IAxis::ExtensionInfo::createShift(std::size_t oldNBins, std::size_t shift)
     {
-        return ExtensionInfo{
-            [shift] (std::size_t idx) { return idx + shift; },
-            oldNBins
-        };
+        return ExtensionInfo{oldNBins, shift, {}};
     }
 
     IAxis::ExtensionInfo IAxis::ExtensionInfo::createMapped(const std::vector<std::size_t> &map)
     {
-        return ExtensionInfo {
-            [map] (std::size_t idx) { return map.at(idx); },
-            map.size()
-        };
+        return ExtensionInfo{map.size(), SIZE_MAX, map};
+    }
+
+    std::size_t IAxis::binOffsetFromNumeric(double) const
+    {
+        throw std::invalid_argument("Axis '" + label() + "' does not accept numeric values");
+    }
+
+    std::size_t IAxis::binOffsetFromCategory(std::string_view) const
+    {
+        throw std::invalid_argument("Axis '" + label() + "' does not accept category values");
+    }
+
+    std::size_t IAxis::binOffsetFromToken(CategoryToken) const
+    {
+        throw std::invalid_argument("Axis '" + label() + "' does not accept category tokens");
+    }
+
+    std::size_t IAxis::binOffsetFromView(const value_view_t &value) const
+    {
+        if (const double *number = std::get_if<double>(&value))
+            return binOffsetFromNumeric(*number);
+        else if (const CategoryToken *token = std::get_if<CategoryToken>(&value))
+            return binOffsetFromToken(*token);
+        else
+            return binOffsetFromCategory(std::get<std::string_view>(value));
+    }
+
+    IAxis::value_t IAxis::ownedValue(const value_view_t &value) const
+    {
+        if (const double *number = std::get_if<double>(&value))
+            return *number;
+        else if (const CategoryToken *token = std::get_if<CategoryToken>(&value))
+            return std::get<std::string>(indexFromBinOffset(token->offset));
+        else
+            return std::string(std::get<std::string_view>(value));
+    }
+
+    void IAxis::binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const
+    {
+        for (std::size_t idx = 0; idx < n; ++idx)
+            offsets[idx] = binOffsetFromNumeric(values[idx]);
+    }
+
+    void IAxis::binOffsetsFromCategory(const std::string *values, std::size_t n, std::size_t *offsets) const
+    {
+        for (std::size_t idx = 0; idx < n; ++idx)
+            offsets[idx] = binOffsetFromCategory(values[idx]);
+    }
+
+    void IAxis::binOffsetsFromTokens(const CategoryToken *tokens, std::size_t n, std::size_t *offsets) const
+    {
+        for (std::size_t idx = 0; idx < n; ++idx)
+            offsets[idx] = binOffsetFromToken(tokens[idx]);
+    }
+
+    void IAxis::binOffsetsFromColumn(
+        const column_t &column, std::size_t first, std::size_t n, std::size_t *offsets) const
+    {
+        if (const double *const *numbers = std::get_if<const double *>(&column))
+            binOffsetsFromNumeric(*numbers + first, n, offsets);
+        else if (const CategoryToken *const *tokens = std::get_if<const CategoryToken *>(&column))
+            binOffsetsFromTokens(*tokens + first, n, offsets);
+        else
+            binOffsetsFromCategory(std::get<const std::string *>(column) + first, n, offsets);
     }
 }
\ No newline at end of file
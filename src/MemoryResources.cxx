@@ -0,0 +1,108 @@
+#include "H5Histograms/MemoryResources.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+    std::size_t roundUp(std::size_t value, std::size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+}
+
+namespace H5Histograms
+{
+    HugePageResource::HugePageResource(std::pmr::memory_resource *upstream)
+        : m_upstream(upstream)
+    {
+    }
+
+    void *HugePageResource::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (bytes < pageSize || alignment > pageSize)
+            return m_upstream->allocate(bytes, alignment);
+        void *p = std::aligned_alloc(pageSize, roundUp(bytes, pageSize));
+        if (!p)
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        // Only a hint, failure just means ordinary pages are used
+        madvise(p, roundUp(bytes, pageSize), MADV_HUGEPAGE);
+#endif
+        return p;
+    }
+
+    void HugePageResource::do_deallocate(void *p, std::size_t bytes, std::size_t alignment)
+    {
+        if (bytes < pageSize || alignment > pageSize)
+            m_upstream->deallocate(p, bytes, alignment);
+        else
+            std::free(p);
+    }
+
+    bool HugePageResource::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    {
+        const HugePageResource *resource = dynamic_cast<const HugePageResource *>(&other);
+        return resource && resource->m_upstream->is_equal(*m_upstream);
+    }
+
+    HugePageResource *hugePageResource()
+    {
+        static HugePageResource resource;
+        return &resource;
+    }
+
+    MonotonicArena::MonotonicArena(std::size_t blockSize, std::pmr::memory_resource *upstream)
+        : m_blockSize(blockSize), m_upstream(upstream), m_current(0), m_used(0)
+    {
+    }
+
+    MonotonicArena::~MonotonicArena()
+    {
+        for (const Block &block : m_blocks)
+            m_upstream->deallocate(block.data, block.size, alignof(std::max_align_t));
+    }
+
+    void MonotonicArena::reset()
+    {
+        m_current = 0;
+        m_used = 0;
+    }
+
+    void *MonotonicArena::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        // Try the current block and then any later blocks kept from before a reset
+        for (; m_current < m_blocks.size(); ++m_current, m_used = 0)
+        {
+            Block &block = m_blocks[m_current];
+            std::size_t start = roundUp(reinterpret_cast<std::uintptr_t>(block.data) + m_used, alignment) -
+                                reinterpret_cast<std::uintptr_t>(block.data);
+            if (start + bytes <= block.size)
+            {
+                m_used = start + bytes;
+                return block.data + start;
+            }
+        }
+        // Blocks from upstream are only guaranteed max_align_t alignment so leave room for more
+        std::size_t size = std::max(m_blockSize, bytes + alignment);
+        m_blocks.push_back({static_cast<char *>(m_upstream->allocate(size, alignof(std::max_align_t))), size});
+        m_current = m_blocks.size() - 1;
+        m_used = 0;
+        return do_allocate(bytes, alignment);
+    }
+
+    void MonotonicArena::do_deallocate(void *, std::size_t, std::size_t)
+    {
+    }
+
+    bool MonotonicArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+    {
+        return this == &other;
+    }
+} //> end namespace H5Histograms
@@ -6,7 +6,16 @@ namespace H5Histograms
 
     std::size_t NumericAxis::binOffsetFromValue(const IAxis::value_t &value) const
     {
-        return binOffsetFromIndex(std::get<1>(findBin(value)));
+        return binOffsetFromNumeric(std::get<1>(value));
+    }
+
+    std::size_t NumericAxis::binOffsetFromNumeric(double value) const
+    {
+        std::size_t binIndex = findBinIndex(value);
+        if (binIndex >= fullNBins())
+            return SIZE_MAX;
+        else
+            return binIndex;
     }
 
     std::size_t NumericAxis::binOffsetFromIndex(const IAxis::index_t &index) const
@@ -20,6 +29,6 @@ namespace H5Histograms
 
     bool NumericAxis::containsValue(const IAxis::value_t &value) const
     {
-        return std::get<1>(value) <= fullNBins();
+        return binOffsetFromNumeric(std::get<1>(value)) != SIZE_MAX;
     }
 }
\ No newline at end of file
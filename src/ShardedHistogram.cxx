@@ -0,0 +1,161 @@
+#include "H5Histograms/ShardedHistogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+    /// The identifiers of the sharded histograms that have not been destroyed yet
+    struct LiveIDs
+    {
+        std::mutex mutex;
+        std::unordered_set<std::size_t> ids;
+    };
+
+    LiveIDs &liveIDs()
+    {
+        static LiveIDs live;
+        return live;
+    }
+
+    std::size_t nextShardedID()
+    {
+        // 0 is reserved to mark an empty cache entry
+        static std::atomic<std::size_t> id{1};
+        std::size_t next = id++;
+        LiveIDs &live = liveIDs();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        live.ids.insert(next);
+        return next;
+    }
+
+    /// The least number of entries in a thread's cache before it is pruned
+    constexpr std::size_t minPruneSize = 16;
+
+    /// Remove the entries of histograms that have been destroyed from a thread's cache
+    template <typename T>
+    void pruneShards(std::unordered_map<std::size_t, T> &shards)
+    {
+        LiveIDs &live = liveIDs();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        for (auto itr = shards.begin(); itr != shards.end();)
+            itr = live.ids.count(itr->first) ? std::next(itr) : shards.erase(itr);
+    }
+}
+
+namespace H5Histograms
+{
+    template <typename STORAGE>
+    ShardedHistogram<STORAGE>::ShardedHistogram(std::vector<std::unique_ptr<IAxis>> &&axes)
+        : m_id(nextShardedID()), m_axes(std::move(axes))
+    {
+    }
+
+    template <typename STORAGE>
+    ShardedHistogram<STORAGE>::ShardedHistogram(const HistogramBase &prototype)
+        : ShardedHistogram(prototype.cloneAxes())
+    {
+    }
+
+    template <typename STORAGE>
+    ShardedHistogram<STORAGE>::~ShardedHistogram()
+    {
+        LiveIDs &live = liveIDs();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        live.ids.erase(m_id);
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> &ShardedHistogram<STORAGE>::local()
+    {
+        // Identifiers are never reused so entries left behind by destroyed histograms are never
+        // found, they are only pruned to stop the cache growing without bound
+        thread_local std::size_t lastID = 0;
+        thread_local Histogram<STORAGE> *last = nullptr;
+        thread_local std::unordered_map<std::size_t, Histogram<STORAGE> *> shards;
+        thread_local std::size_t pruneSize = minPruneSize;
+        if (lastID == m_id)
+            return *last;
+        auto itr = shards.find(m_id);
+        if (itr == shards.end())
+        {
+            // Pruning whenever the cache doubles keeps it within twice the live histograms that
+            // this thread fills, at an amortised constant cost per new shard
+            if (shards.size() >= pruneSize)
+            {
+                pruneShards(shards);
+                pruneSize = std::max(2 * shards.size(), minPruneSize);
+            }
+            std::unique_ptr<Shard> shard = std::make_unique<Shard>(cloneAxes());
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shards.push_back(std::move(shard));
+            itr = shards.emplace(m_id, &m_shards.back()->histogram).first;
+        }
+        lastID = m_id;
+        last = itr->second;
+        return *last;
+    }
+
+    template <typename STORAGE>
+    std::size_t ShardedHistogram<STORAGE>::nShards() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_shards.size();
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> ShardedHistogram<STORAGE>::merged() const
+    {
+        Histogram<STORAGE> result = empty();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<Shard> &shard : m_shards)
+            result.merge(shard->histogram);
+        return result;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> ShardedHistogram<STORAGE>::flush()
+    {
+        Histogram<STORAGE> result = empty();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<Shard> &shard : m_shards)
+        {
+            result.merge(shard->histogram);
+            // Reset the shard in place as the filling threads hold pointers to it
+            shard->histogram = empty();
+        }
+        return result;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> ShardedHistogram<STORAGE>::empty() const
+    {
+        return Histogram<STORAGE>(cloneAxes());
+    }
+
+    template <typename STORAGE>
+    std::vector<std::unique_ptr<IAxis>> ShardedHistogram<STORAGE>::cloneAxes() const
+    {
+        std::vector<std::unique_ptr<IAxis>> axes;
+        axes.reserve(m_axes.size());
+        for (const std::unique_ptr<IAxis> &axis : m_axes)
+            axes.push_back(axis->clone());
+        return axes;
+    }
+
+    // Force the instantiation of the types defined in Histogram.h
+    template class ShardedHistogram<int>;
+    template class ShardedHistogram<unsigned int>;
+    template class ShardedHistogram<char>;
+    template class ShardedHistogram<signed char>;
+    template class ShardedHistogram<unsigned char>;
+    template class ShardedHistogram<short>;
+    template class ShardedHistogram<unsigned short>;
+    template class ShardedHistogram<long>;
+    template class ShardedHistogram<long long>;
+    template class ShardedHistogram<unsigned long>;
+    template class ShardedHistogram<unsigned long long>;
+    template class ShardedHistogram<float>;
+    template class ShardedHistogram<double>;
+} //> end namespace H5Histograms
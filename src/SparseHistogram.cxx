@@ -0,0 +1,279 @@
+#include "H5Histograms/SparseHistogram.h"
+#include "H5Composites/FixedLengthVectorTraits.h"
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+    /// The number of events for which the batched fill calculates offsets in one go
+    constexpr std::size_t fillBlockSize = 256;
+
+    /// The index is rebuilt to keep at most this fraction of the slots filled
+    constexpr std::size_t indexLoadDenominator = 2;
+
+    std::size_t hashOffset(std::size_t offset)
+    {
+        // Neighbouring bins have consecutive offsets so mix the bits before masking
+        std::uint64_t h = offset * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+}
+
+namespace H5Histograms
+{
+    template <typename STORAGE>
+    const H5Composites::CompositeDefinition<SparseHistogram<STORAGE>> &SparseHistogram<STORAGE>::compositeDefinition()
+    {
+        static H5Composites::CompositeDefinition<SparseHistogram> definition;
+        static bool init = false;
+        if (!init)
+        {
+            definition.template add<H5Composites::FLVector<IAxisUPtr>>(&SparseHistogram::m_axes, "axes");
+            definition.template add(&SparseHistogram::m_nEntries, "nEntries");
+            definition.template add<H5Composites::FLVector<std::size_t>>(&SparseHistogram::m_coordinates, "coordinates");
+            definition.template add<H5Composites::FLVector<STORAGE>>(&SparseHistogram::m_counts, "counts");
+            definition.template add<H5Composites::FLVector<STORAGE>>(&SparseHistogram::m_sumW2, "sumW2");
+            init = true;
+        }
+        return definition;
+    }
+
+    template <typename STORAGE>
+    HistogramBase::index_t SparseHistogram<STORAGE>::const_iterator::indices() const
+    {
+        std::vector<std::size_t> offsets = m_histo.m_indexer.axisOffsets(offset());
+        HistogramBase::index_t ret(offsets.size());
+        for (std::size_t idx = 0; idx < offsets.size(); ++idx)
+            ret[idx] = m_histo.axis(idx).indexFromBinOffset(offsets[idx]);
+        return ret;
+    }
+
+    template <typename STORAGE>
+    SparseHistogram<STORAGE>::SparseHistogram(const void *buffer, const H5::DataType &dtype) : HistogramBase({})
+    {
+        if (!isSparse(dtype))
+            throw std::invalid_argument("Data type does not describe a sparse histogram");
+        compositeDefinition().readBuffer(*this, buffer, dtype);
+        calculateStrides();
+        buildIndex();
+    }
+
+    template <typename STORAGE>
+    SparseHistogram<STORAGE>::SparseHistogram(std::vector<std::unique_ptr<IAxis>> &&axes)
+        : HistogramBase(std::move(axes)),
+          m_nEntries(0)
+    {
+        buildIndex();
+    }
+
+    template <typename STORAGE>
+    H5::DataType SparseHistogram<STORAGE>::h5DType() const
+    {
+        return compositeDefinition().dtype(*this);
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::writeBuffer(void *buffer) const
+    {
+        compositeDefinition().writeBuffer(*this, buffer);
+    }
+
+    template <typename STORAGE>
+    std::string SparseHistogram<STORAGE>::dtypeKey() const
+    {
+        return HistogramBase::dtypeKey() + "|" + std::to_string(nFilledBins());
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::fill(const value_t &values, STORAGE weight)
+    {
+        std::size_t offset = binOffsetFromValues(values);
+        if (offset == SIZE_MAX)
+        {
+            std::vector<IAxis::ExtensionInfo> extensions = extendAxes(values, offset);
+            resize(extensions);
+        }
+        add(offset, weight, weight * weight);
+        ++m_nEntries;
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::fill(const IAxis::value_view_t *values, std::size_t nValues, STORAGE weight)
+    {
+        std::size_t offset = binOffsetFromValues(values, nValues);
+        if (offset == SIZE_MAX)
+        {
+            std::vector<IAxis::ExtensionInfo> extensions = extendAxes(ownedValues(values, nValues), offset);
+            resize(extensions);
+        }
+        add(offset, weight, weight * weight);
+        ++m_nEntries;
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::fillColumns(
+        const std::vector<IAxis::column_t> &columns,
+        std::size_t nEvents,
+        const STORAGE *weights)
+    {
+        std::array<std::size_t, fillBlockSize> offsets;
+        std::array<std::size_t, fillBlockSize> scratch;
+        std::size_t first = 0;
+        while (first < nEvents)
+        {
+            std::size_t n = std::min(nEvents - first, fillBlockSize);
+            binOffsetsFromColumns(columns, first, n, offsets.data(), scratch.data());
+            // Only fill up to the first event that has no bin
+            std::size_t nValid = std::find(offsets.begin(), offsets.begin() + n, SIZE_MAX) - offsets.begin();
+            for (std::size_t idx = 0; idx < nValid; ++idx)
+            {
+                STORAGE weight = weights ? weights[first + idx] : 1;
+                add(offsets[idx], weight, weight * weight);
+            }
+            m_nEntries += nValid;
+            first += nValid;
+            if (nValid != n)
+            {
+                // Extending an axis changes the offsets of every later event so fill this one on
+                // its own and restart the block after it
+                fill(valuesFromColumns(columns, first), weights ? weights[first] : 1);
+                ++first;
+            }
+        }
+    }
+
+    template <typename STORAGE>
+    STORAGE SparseHistogram<STORAGE>::contents(const index_t &indices) const
+    {
+        std::size_t idx = find(binOffsetFromIndices(indices));
+        return idx == SIZE_MAX ? 0 : m_counts[idx];
+    }
+
+    template <typename STORAGE>
+    STORAGE SparseHistogram<STORAGE>::sumW2(const index_t &indices) const
+    {
+        std::size_t idx = find(binOffsetFromIndices(indices));
+        return idx == SIZE_MAX ? 0 : m_sumW2[idx];
+    }
+
+    template <typename STORAGE>
+    SparseHistogram<STORAGE> &SparseHistogram<STORAGE>::operator+=(const SparseHistogram &h)
+    {
+        std::vector<IAxis::ExtensionInfo> extensions = compareAxes(h);
+        for (std::size_t idx = 0; idx < h.nFilledBins(); ++idx)
+            add(mapOffset(h.m_coordinates[idx], h.m_indexer, m_indexer, extensions), h.m_counts[idx], h.m_sumW2[idx]);
+        m_nEntries += h.m_nEntries;
+        return *this;
+    }
+
+    template <typename STORAGE>
+    SparseHistogram<STORAGE> &SparseHistogram<STORAGE>::operator+=(const Histogram<STORAGE> &h)
+    {
+        std::vector<IAxis::ExtensionInfo> extensions = compareAxes(h);
+        if (h.fullNBins() > 0)
+            for (const std::vector<std::size_t> &axisOffsets : h.m_indexer)
+            {
+                // The dense storage may have headroom around the bins
+                std::size_t storageOffset = h.storageOffset(axisOffsets);
+                STORAGE count = h.countAt(storageOffset);
+                STORAGE sumW2 = h.sumW2At(storageOffset);
+                if (count != 0 || sumW2 != 0)
+                    add(mapOffset(h.m_indexer.offset_noCheck(axisOffsets), h.m_indexer, m_indexer, extensions), count, sumW2);
+            }
+        m_nEntries += h.m_nEntries;
+        return *this;
+    }
+
+    template <typename STORAGE>
+    Histogram<STORAGE> SparseHistogram<STORAGE>::toDense() const
+    {
+        Histogram<STORAGE> dense(cloneAxes());
+        dense += *this;
+        return dense;
+    }
+
+    template <typename STORAGE>
+    std::size_t SparseHistogram<STORAGE>::find(std::size_t offset) const
+    {
+        std::size_t mask = m_index.size() - 1;
+        for (std::size_t slot = hashOffset(offset) & mask; m_index[slot] != SIZE_MAX; slot = (slot + 1) & mask)
+            if (m_coordinates[m_index[slot]] == offset)
+                return m_index[slot];
+        return SIZE_MAX;
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::add(std::size_t offset, STORAGE weight, STORAGE weight2)
+    {
+        if (offset >= fullNBins())
+            throw std::out_of_range("Bin offset out of range");
+        std::size_t mask = m_index.size() - 1;
+        std::size_t slot = hashOffset(offset) & mask;
+        for (; m_index[slot] != SIZE_MAX; slot = (slot + 1) & mask)
+        {
+            std::size_t idx = m_index[slot];
+            if (m_coordinates[idx] == offset)
+            {
+                m_counts[idx] += weight;
+                m_sumW2[idx] += weight2;
+                return;
+            }
+        }
+        // This is a new bin
+        m_coordinates.push_back(offset);
+        m_counts.push_back(weight);
+        m_sumW2.push_back(weight2);
+        if (indexLoadDenominator * m_coordinates.size() > m_index.size())
+            buildIndex();
+        else
+            m_index[slot] = m_coordinates.size() - 1;
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::buildIndex()
+    {
+        // Keep the size a power of two so that the slot can be taken with a mask
+        std::size_t size = 8;
+        while (size < indexLoadDenominator * m_coordinates.size())
+            size *= 2;
+        m_index.assign(size, SIZE_MAX);
+        std::size_t mask = size - 1;
+        for (std::size_t idx = 0; idx < m_coordinates.size(); ++idx)
+        {
+            std::size_t slot = hashOffset(m_coordinates[idx]) & mask;
+            while (m_index[slot] != SIZE_MAX)
+                slot = (slot + 1) & mask;
+            m_index[slot] = idx;
+        }
+    }
+
+    template <typename STORAGE>
+    void SparseHistogram<STORAGE>::resize(const std::vector<IAxis::ExtensionInfo> &extensions)
+    {
+        if (extensions.size() != nDims())
+            throw std::invalid_argument("Number of axis extensions does not match the number of dimensions!");
+        // Right now the actual axes are updated but the indexer is not
+        ArrayIndexer oldIndexer = m_indexer;
+        calculateStrides();
+        // Extending an axis never merges bins so each filled bin keeps its own storage
+        for (std::size_t &coordinate : m_coordinates)
+            coordinate = mapOffset(coordinate, oldIndexer, m_indexer, extensions);
+        buildIndex();
+    }
+
+    // Force the instantiation of the types defined in Histogram.h
+    template class SparseHistogram<int>;
+    template class SparseHistogram<unsigned int>;
+    template class SparseHistogram<char>;
+    template class SparseHistogram<signed char>;
+    template class SparseHistogram<unsigned char>;
+    template class SparseHistogram<short>;
+    template class SparseHistogram<unsigned short>;
+    template class SparseHistogram<long>;
+    template class SparseHistogram<long long>;
+    template class SparseHistogram<unsigned long>;
+    template class SparseHistogram<unsigned long long>;
+    template class SparseHistogram<float>;
+    template class SparseHistogram<double>;
+} //> end namespace H5Histograms
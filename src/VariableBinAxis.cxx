@@ -2,6 +2,34 @@
 #include "H5Composites/FixedLengthStringTraits.h"
 #include "H5Composites/FixedLengthVectorTraits.h"
 #include <algorithm>
+#include <numeric>
+
+namespace {
+    /// Axes with fewer edges than this just use a binary search
+    constexpr std::size_t minEdgesForLookup = 16;
+    /// The number of buckets per edge
+    constexpr std::size_t bucketsPerEdge = 2;
+
+    /**
+     * @brief Branchless version of std::lower_bound
+     * 
+     * The comparison result selects the next position instead of driving a branch, so the search
+     * does not suffer from mispredictions when values are randomly distributed
+     */
+    std::size_t branchlessLowerBound(const double *first, std::size_t n, double value)
+    {
+        if (n == 0)
+            return 0;
+        const double *base = first;
+        while (n > 1)
+        {
+            std::size_t half = n / 2;
+            base = base[half - 1] < value ? base + half : base;
+            n -= half;
+        }
+        return (base - first) + (*base < value);
+    }
+}
 
 H5HISTOGRAMS_REGISTER_IAXIS(H5Histograms::VariableBinAxis)
 
@@ -21,11 +49,15 @@ namespace H5Histograms
     }
 
     VariableBinAxis::VariableBinAxis(const std::string &label, const std::vector<double> &edges)
-        : NumericAxis(label), m_edges(edges) {}
+        : NumericAxis(label), m_edges(edges)
+    {
+        buildLookup();
+    }
 
     VariableBinAxis::VariableBinAxis(const void *buffer, const H5::DataType &dtype) : NumericAxis("")
     {
         compositeDefinition().readBuffer(*this, buffer, dtype);
+        buildLookup();
     }
 
     H5::DataType VariableBinAxis::h5DType() const
@@ -51,6 +83,16 @@ namespace H5Histograms
         return H5Composites::toBuffer(axis);
     }
 
+    std::unique_ptr<IAxis> VariableBinAxis::clone() const
+    {
+        return std::make_unique<VariableBinAxis>(*this);
+    }
+
+    std::string VariableBinAxis::dtypeKey() const
+    {
+        return registeredName() + ";" + std::to_string(m_label.size()) + ";" + std::to_string(m_edges.size());
+    }
+
     std::size_t VariableBinAxis::nBins() const
     {
         return m_edges.size() - 1;
@@ -63,8 +105,50 @@ namespace H5Histograms
 
     IAxis::index_t VariableBinAxis::findBin(const IAxis::value_t &value) const
     {
-        auto itr = std::lower_bound(m_edges.begin(), m_edges.end(), std::get<1>(value));
-        return static_cast<std::size_t>(std::distance(m_edges.begin(), itr));
+        return findBinIndex(std::get<1>(value));
+    }
+
+    std::size_t VariableBinAxis::findBinIndex(double value) const
+    {
+        if (m_buckets.empty())
+            return branchlessLowerBound(m_edges.data(), m_edges.size(), value);
+        // Written so that NaN goes into the underflow like it does for the binary search
+        if (!(value > m_edges.front()))
+            return 0;
+        if (value > m_edges.back())
+            return m_edges.size();
+        std::size_t b = bucket(value);
+        return m_buckets[b] + branchlessLowerBound(
+            m_edges.data() + m_buckets[b], m_buckets[b + 1] - m_buckets[b], value);
+    }
+
+    void VariableBinAxis::binOffsetsFromNumeric(const double *values, std::size_t n, std::size_t *offsets) const
+    {
+        // Every value has a bin as the axis has under and overflow bins
+        for (std::size_t idx = 0; idx < n; ++idx)
+            offsets[idx] = VariableBinAxis::findBinIndex(values[idx]);
+    }
+
+    void VariableBinAxis::buildLookup()
+    {
+        m_buckets.clear();
+        if (m_edges.size() < minEdgesForLookup)
+            return;
+        std::size_t nBuckets = bucketsPerEdge * m_edges.size();
+        m_invBucketWidth = nBuckets / (m_edges.back() - m_edges.front());
+        m_buckets.assign(nBuckets + 1, 0);
+        // The bucket function is monotonic, so any value in bucket b is greater than every edge in
+        // an earlier bucket and less than every edge in a later one. Its lower bound is therefore
+        // between the first edge in bucket b and the first edge in bucket b+1
+        for (double edge : m_edges)
+            ++m_buckets[bucket(edge) + 1];
+        std::partial_sum(m_buckets.begin(), m_buckets.end(), m_buckets.begin());
+    }
+
+    std::size_t VariableBinAxis::bucket(double value) const
+    {
+        std::size_t b = (value - m_edges.front()) * m_invBucketWidth;
+        return std::min(b, m_buckets.size() - 2);
     }
 
     IAxis::ExtensionInfo VariableBinAxis::extendAxis(const IAxis::value_t &value, std::size_t &offset)
@@ -80,4 +164,26 @@ namespace H5Histograms
             throw std::invalid_argument("VariableBinAxes edges do not match!");
         return ExtensionInfo::createIdentity(fullNBins());
     }
+
+    IAxis::ExtensionInfo VariableBinAxis::mergeAxis(const IAxis &_other)
+    {
+        const VariableBinAxis &other = dynamic_cast<const VariableBinAxis &>(_other);
+        if (m_label != other.m_label || m_edges != other.m_edges)
+            throw std::invalid_argument("VariableBinAxes do not match!");
+        return ExtensionInfo::createIdentity(fullNBins());
+    }
+
+    std::unique_ptr<IAxis> VariableBinAxis::slice(std::size_t first, std::size_t last, std::size_t &offset) const
+    {
+        if (first >= last || last > fullNBins())
+            throw std::out_of_range("Invalid bin range for axis '" + m_label + "'");
+        // Offset 0 is the underflow bin
+        std::size_t firstBin = std::max<std::size_t>(first, 1) - 1;
+        std::size_t lastBin = std::min(last - 1, nBins());
+        if (firstBin >= lastBin)
+            throw std::invalid_argument("Bin range for axis '" + m_label + "' holds no non-overflow bins");
+        offset = first == 0 ? 0 : 1;
+        return std::make_unique<VariableBinAxis>(
+            m_label, std::vector<double>(m_edges.begin() + firstBin, m_edges.begin() + lastBin + 1));
+    }
 } //> end namespace H5Histograms
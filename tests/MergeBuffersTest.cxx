@@ -0,0 +1,60 @@
+/**
+ * @file MergeBuffersTest.cxx
+ * @author Jon Burr
+ * @brief Check that merging histograms written with narrow integers does not overflow
+ * @version 0.0.0
+ * @date 2022-01-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ * Adaptive histograms are written with the narrowest type that holds their bins, so two that
+ * each hold 200 entries in a bin are written as uint8 and their merged bin (400) does not fit.
+ */
+
+#include "H5Histograms/AdaptiveHistogram.h"
+#include "H5Histograms/FixedBinAxis.h"
+#include "H5Histograms/Histogram.h"
+
+#include <iostream>
+#include <vector>
+
+namespace {
+    H5Histograms::AdaptiveHistogram filled(std::size_t n)
+    {
+        H5Histograms::AdaptiveHistogram h = H5Histograms::AdaptiveHistogram::create(
+            H5Histograms::FixedBinAxis("x", 4, 0, 4));
+        for (std::size_t idx = 0; idx < n; ++idx)
+            h.fill({1.5});
+        h.fill({2.5});
+        return h;
+    }
+} // namespace
+
+int main()
+{
+    H5Histograms::AdaptiveHistogram a = filled(200);
+    H5Histograms::AdaptiveHistogram b = filled(255);
+    if (a.storageDType() != H5::PredType::NATIVE_UINT8 || b.storageDType() != H5::PredType::NATIVE_UINT8)
+    {
+        std::cerr << "Inputs are not stored as uint8" << std::endl;
+        return 1;
+    }
+    H5::DataType aType = a.h5DType();
+    H5::DataType bType = b.h5DType();
+    std::vector<char> aBuffer(aType.getSize());
+    std::vector<char> bBuffer(bType.getSize());
+    a.writeBuffer(aBuffer.data());
+    b.writeBuffer(bBuffer.data());
+
+    H5Composites::H5Buffer merged = H5Histograms::HistogramBase::mergeBuffers(
+        {{aType, aBuffer.data()}, {bType, bBuffer.data()}});
+    const H5Histograms::Histogram<unsigned long> h(merged.get(), merged.dtype());
+    bool ok = h.contents({std::size_t(2)}) == 455 && h.contents({std::size_t(3)}) == 2 && h.nEntries() == 457;
+    if (!ok)
+    {
+        std::cerr << "Merged contents " << h.contents({std::size_t(2)}) << ", " << h.contents({std::size_t(3)})
+                  << " with " << h.nEntries() << " entries, expected 455, 2 with 457" << std::endl;
+        return 1;
+    }
+    return 0;
+}